@@ -0,0 +1,425 @@
+/* bench.c - benchmarks of the generator and of scripted browser sessions
+    author: Andrew Klinge
+*/
+
+// the browser's state and functions are static, so build it in here
+#define main browser_main
+#include "browser.c"
+#undef main
+
+#include "parallel.h"
+
+static const char *BENCH_USAGE =
+    "usage: artifactor-bench [-j THREADS] [-n FRAMES] [OUTPUT.json]\n"
+    "Measures generator throughput and browser frame times, printing them\n"
+    "and saving them as JSON (default: bench.json).\n"
+    "  -j THREADS   worker threads for multithreaded runs (default: cores)\n"
+    "  -n FRAMES    frames per browser session (default: 1000)\n";
+
+#define GENERATE_COUNT (1 << 18) // ids for single threaded runs
+#define GENERATE_BATCH 256
+#define WIDE_WIDTH 1920 // window of the zoomed out session
+#define WIDE_HEIGHT 1080
+
+static SDL_Window *bench_window;
+
+/* frame times of a scripted browser session. */
+typedef struct Session {
+    const char *name;
+    int frames;
+    double *times; // seconds, sorted once finished
+    int64_t moves; // rows scrolled over, or jumps
+} Session;
+
+/* generates the given ids on one worker, by the version ctx points to. */
+static void generate_batches(void *ctx, uint64_t start, uint64_t count,
+        int worker) {
+    const int version = *(const int *) ctx;
+    PackedArtifact artifacts[GENERATE_BATCH];
+    for (uint64_t i = 0; i < count; i += GENERATE_BATCH) {
+        int n = count - i < GENERATE_BATCH ? count - i : GENERATE_BATCH;
+        generate_artifacts_packed(artifacts, start + i, n, version);
+    }
+}
+
+/* returns ids/sec of generate_artifact, one at a time. */
+static double bench_generate_artifact() {
+    int pixels[GENERATED_SIZE * GENERATED_SIZE];
+    double start = seconds();
+    for (int id = 0; id < GENERATE_COUNT; id++) {
+        generate_artifact(pixels, id);
+    }
+    return GENERATE_COUNT / (seconds() - start);
+}
+
+/* returns ids/sec of batched generation by the given generator version over
+ * the given number of threads.
+ */
+static double bench_generate_batched(int threads, int version) {
+    uint64_t count = (uint64_t) GENERATE_COUNT * 4 * threads;
+    double start = seconds();
+    parallel_for(count, GENERATE_BATCH * 16, threads, generate_batches, 
+        &version);
+    return count / (seconds() - start);
+}
+
+/* returns ids/sec of generating artifacts of the given format as RGBA. */
+static double bench_generate_format(ArtifactFormat format) {
+    const int size = format.size;
+    const int count = GENERATE_COUNT / (size / GENERATED_SIZE) 
+        / (size / GENERATED_SIZE);
+    uint32_t *pixels = malloc(sizeof(uint32_t) * GENERATE_BATCH * size * size);
+    if (pixels == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    double start = seconds();
+    for (int id = 0; id < count; id += GENERATE_BATCH) {
+        generate_artifacts_rgba(pixels, id, GENERATE_BATCH, &format, 
+            0xff000000);
+    }
+    double elapsed = seconds() - start;
+    free(pixels);
+    return count / elapsed;
+}
+
+/* returns ids/sec of generating 8x8 artifacts and encoding them as images
+ * of the given type and scale, one at a time. sets bytes to their average 
+ * size.
+ */
+static double bench_encode(int type, int scale, double *bytes) {
+    const int count = GENERATE_COUNT / 4;
+    ArtifactFormat format = ARTIFACT_DEFAULT_FORMAT;
+    uint32_t pixels[GENERATE_BATCH * GENERATED_SIZE * GENERATED_SIZE];
+    Encoder encoder = {0};
+    uint64_t total = 0;
+    double start = seconds();
+    for (int id = 0; id < count; id += GENERATE_BATCH) {
+        generate_artifacts_rgba(pixels, id, GENERATE_BATCH, &format, 
+            IMAGE_ALPHA);
+        for (int i = 0; i < GENERATE_BATCH; i++) {
+            Image image = {.width = GENERATED_SIZE, .height = GENERATED_SIZE,
+                .pixels = pixels + i * GENERATED_SIZE * GENERATED_SIZE};
+            if (encode_image(&encoder, &image, scale, type) != 0) {
+                fprintf(stderr, "Out of memory\n");
+                exit(EXIT_FAILURE);
+            }
+            total += encoder.size;
+        }
+    }
+    double elapsed = seconds() - start;
+    free_encoder(&encoder);
+    *bytes = (double) total / count;
+    return count / elapsed;
+}
+
+/* returns seconds per row of generating and uploading browser rows. */
+static double bench_generate_row_SDL() {
+    const int count = 2000;
+    double start = seconds();
+    for (int i = 0; i < count; i++) {
+        generate_row_SDL(1000000 + i);
+    }
+    return (seconds() - start) / count;
+}
+
+/* queues a key press, as if from the keyboard. */
+static void press(SDL_Keycode key, bool repeat) {
+    SDL_Event event = {.type = SDL_KEYDOWN};
+    event.key.keysym.sym = key;
+    event.key.repeat = repeat;
+    SDL_PushEvent(&event);
+}
+
+/* queues a key press with shift held. */
+static void press_shifted(SDL_Keycode key) {
+    SDL_Event event = {.type = SDL_KEYDOWN};
+    event.key.keysym.sym = key;
+    event.key.keysym.mod = KMOD_SHIFT;
+    SDL_PushEvent(&event);
+}
+
+/* queues a key being let go. */
+static void release(SDL_Keycode key) {
+    SDL_Event event = {.type = SDL_KEYUP};
+    event.key.keysym.sym = key;
+    SDL_PushEvent(&event);
+}
+
+/* handles the queued input and renders, like an iteration of the main loop.
+ * returns the time it took.
+ */
+static double frame() {
+    double start = seconds();
+    update();
+    if (dirty) {
+        render();
+        dirty = false;
+    }
+    return seconds() - start;
+}
+
+/* waits for the scroll's next step in real time, as the main loop would, then
+ * runs a frame. returns the time it took, not counting the wait.
+ */
+static double scroll_frame() {
+    while (scroll_wait() > 0) SDL_Delay(1);
+    return frame();
+}
+
+static int compare_times(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+/* returns the given percentile of a finished session's frame times. */
+static double percentile(const Session *session, int percent) {
+    int i = (int64_t) session->frames * percent / 100;
+    return session->times[i < session->frames ? i : session->frames - 1];
+}
+
+/* scrolls down one row per frame, as fast as frames can be drawn. */
+static void session_scroll(Session *session) {
+    jump(0);
+    int64_t first = top;
+    for (int i = 0; i < session->frames; i++) {
+        press(SDLK_DOWN, false);
+        release(SDLK_DOWN);
+        session->times[i] = frame();
+    }
+    session->moves = top - first;
+}
+
+/* types in random ids to jump to, a digit per frame. */
+static void session_jump(Session *session) {
+    uint32_t state = 1; // xorshift, so every run jumps to the same ids
+    char typed[MAX_DIGITS] = "";
+    int typing = 0; // next digit to type, of typed
+    for (int i = 0; i < session->frames; i++) {
+        if (typed[typing] == '\0') {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            snprintf(typed, MAX_DIGITS, "%u", state);
+            typing = 0;
+        }
+        press(typed[typing], false);
+        typing++;
+        if (typed[typing] == '\0') {
+            press(SDLK_RETURN, false);
+            session->moves++;
+        }
+        session->times[i] = frame();
+    }
+}
+
+/* holds the down key, scrolling faster and faster, a frame at a time in real
+ * time so the prefetch thread gets the time it would with a user.
+ */
+static void session_hold(Session *session) {
+    jump(0);
+    int64_t first = top;
+    press(SDLK_DOWN, false);
+    for (int i = 0; i < session->frames; i++) {
+        session->times[i] = scroll_frame();
+    }
+    release(SDLK_DOWN);
+    frame();
+    session->moves = top - first;
+}
+
+/* flings every frame (in real time, like session_hold()) so the screen 
+ * scrolls at its top speed, turning around at the ends of the list.
+ */
+static void session_fling(Session *session) {
+    jump(0);
+    SDL_Keycode key = SDLK_DOWN;
+    for (int i = 0; i < session->frames; i++) {
+        int64_t from = top;
+        press_shifted(key);
+        session->times[i] = scroll_frame();
+        session->moves += from < top ? top - from : from - top;
+        if (top == max_top()) key = SDLK_UP;
+        if (top == 0) key = SDLK_DOWN;
+    }
+    stop_scroll();
+}
+
+/* scrolls down like session_scroll(), zoomed all the way out in a wide 
+ * window (thousands of tiles on screen).
+ */
+static void session_zoomed(Session *session) {
+    SDL_SetWindowSize(bench_window, WIDE_WIDTH, WIDE_HEIGHT);
+    scale = 1;
+    layout();
+    SDL_FlushEvent(SDL_WINDOWEVENT); // already laid out
+    session_scroll(session);
+}
+
+/* runs a browser session, printing its frame times. */
+static void run_session(Session *session, void (*script)(Session *)) {
+    session->times = malloc(sizeof(double) * session->frames);
+    if (session->times == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    script(session);
+    qsort(session->times, session->frames, sizeof(double), compare_times);
+    printf("%-22s p50 %7.3f ms  p99 %7.3f ms  max %7.3f ms  (%lld moves)\n",
+        session->name, percentile(session, 50) * 1000,
+        percentile(session, 99) * 1000, percentile(session, 100) * 1000,
+        (long long) session->moves);
+}
+
+int main(int argc, char **argv) {
+    const char *output = "bench.json";
+    int threads = parallel_threads();
+    int frames = 1000;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "j:n:")) != -1) {
+        bool valid = true;
+        switch (opt) {
+            case 'j': valid = parse_positive(optarg, &threads); break;
+            case 'n': valid = parse_positive(optarg, &frames); break;
+            default: valid = false; break;
+        }
+        if (!valid) {
+            fputs(BENCH_USAGE, stderr);
+            return EXIT_FAILURE;
+        }
+    }
+    if (optind < argc) output = argv[optind++];
+    if (optind < argc) {
+        fputs(BENCH_USAGE, stderr);
+        return EXIT_FAILURE;
+    }
+
+    // generator
+    double single = bench_generate_artifact();
+    printf("%-22s %12.0f ids/s\n", "generate_artifact", single);
+    double batched = bench_generate_batched(1, ARTIFACT_V1);
+    printf("%-22s %12.0f ids/s\n", "batched, 1 thread", batched);
+    double parallel = bench_generate_batched(threads, ARTIFACT_V1);
+    printf("%-22s %12.0f ids/s (%d threads)\n", "batched, threaded",
+        parallel, threads);
+    double batched_v2 = bench_generate_batched(1, ARTIFACT_V2);
+    printf("%-22s %12.0f ids/s\n", "batched v2, 1 thread", batched_v2);
+    const int sizes[] = {8, 16, 32};
+    double sized[3];
+    for (int i = 0; i < 3; i++) {
+        ArtifactFormat format = {.size = sizes[i]};
+        sized[i] = bench_generate_format(format);
+        printf("%-15s %2dx%-2d %12.0f ids/s\n", "rgba, 1 thread", sizes[i], 
+            sizes[i], sized[i]);
+    }
+    double d4 = bench_generate_format(
+        (ArtifactFormat) {.size = GENERATED_SIZE, .symmetry = ARTIFACT_SYM_D4});
+    printf("%-22s %12.0f ids/s\n", "rgba d4, 1 thread", d4);
+    double sized_v2 = bench_generate_format((ArtifactFormat) {.size = 32, 
+        .version = ARTIFACT_V2});
+    printf("%-22s %12.0f ids/s\n", "rgba v2 32x32, 1 thread", sized_v2);
+    // encoding, next to generating alone
+    const int encode_types[] = {IMAGE_PNG, IMAGE_PNG, IMAGE_GIF};
+    const int encode_scales[] = {1, 8, 8};
+    double encoded[3], encoded_bytes[3];
+    for (int i = 0; i < 3; i++) {
+        encoded[i] = bench_encode(encode_types[i], encode_scales[i], 
+            &encoded_bytes[i]);
+        printf("encode %s x%-2d %15.0f ids/s (%.0f bytes)\n", 
+            image_format_name(encode_types[i]), encode_scales[i], encoded[i],
+            encoded_bytes[i]);
+    }
+
+    // headless browser, drawn in software
+    setenv("SDL_VIDEODRIVER", "dummy", 0);
+    if (SDL_Init(SDL_INIT_VIDEO) != 0) {
+        fprintf(stderr, "Failed to init SDL: %s\n", SDL_GetError());
+        return EXIT_FAILURE;
+    }
+    SDL_Window *window = bench_window = SDL_CreateWindow("Artifactor",
+        SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, WINDOW_WIDTH,
+        WINDOW_HEIGHT, SDL_WINDOW_HIDDEN);
+    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE);
+    if (window == NULL || renderer == NULL) {
+        fprintf(stderr, "Failed to create renderer: %s\n", SDL_GetError());
+        return EXIT_FAILURE;
+    }
+    TTF_Init();
+    init();
+
+    double row_time = bench_generate_row_SDL();
+    printf("%-22s %8.3f ms/row (%.2f us/artifact)\n", "generate_row_SDL",
+        row_time * 1000, row_time * 1e6 / cols);
+
+    Session sessions[] = {
+        {.name = "scroll", .frames = frames},
+        {.name = "jump", .frames = frames},
+        {.name = "hold", .frames = frames / 4}, // in real time, so fewer
+        {.name = "fling", .frames = frames / 4},
+        {.name = "scroll, zoomed out", .frames = frames},
+        {.name = "fling, zoomed out", .frames = frames / 4}, // still zoomed
+    };
+    void (*scripts[])(Session *) = {session_scroll, session_jump,
+        session_hold, session_fling, session_zoomed, session_fling};
+    const int session_count = sizeof(sessions) / sizeof(sessions[0]);
+    const int row_artifacts = cols;
+    for (int i = 0; i < session_count; i++) {
+        run_session(&sessions[i], scripts[i]);
+    }
+    printf("%-22s %d tiles on screen\n", "zoomed out", rows * cols);
+
+    // save results
+    FILE *file = fopen(output, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Failed to open %s: %s\n", output, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    fprintf(file, "{\n");
+    fprintf(file, "  \"generate_artifact_ids_per_sec\": %.0f,\n", single);
+    fprintf(file, "  \"batched_ids_per_sec\": %.0f,\n", batched);
+    fprintf(file, "  \"threaded_ids_per_sec\": %.0f,\n", parallel);
+    fprintf(file, "  \"threads\": %d,\n", threads);
+    fprintf(file, "  \"batched_v2_ids_per_sec\": %.0f,\n", batched_v2);
+    for (int i = 0; i < 3; i++) {
+        fprintf(file, "  \"rgba_%d_ids_per_sec\": %.0f,\n", sizes[i], 
+            sized[i]);
+    }
+    fprintf(file, "  \"rgba_d4_ids_per_sec\": %.0f,\n", d4);
+    fprintf(file, "  \"rgba_32_v2_ids_per_sec\": %.0f,\n", sized_v2);
+    for (int i = 0; i < 3; i++) {
+        fprintf(file, "  \"encode_%s_%d_ids_per_sec\": %.0f,\n", 
+            image_format_name(encode_types[i]), encode_scales[i], encoded[i]);
+        fprintf(file, "  \"encode_%s_%d_bytes\": %.0f,\n", 
+            image_format_name(encode_types[i]), encode_scales[i], 
+            encoded_bytes[i]);
+    }
+    fprintf(file, "  \"generate_row_SDL_ms\": %.4f,\n", row_time * 1000);
+    fprintf(file, "  \"row_artifacts\": %d,\n", row_artifacts);
+    fprintf(file, "  \"zoomed_out_tiles\": %d,\n", rows * cols);
+    fprintf(file, "  \"sessions\": {\n");
+    for (int i = 0; i < session_count; i++) {
+        Session *session = &sessions[i];
+        fprintf(file, "    \"%s\": {\"frames\": %d, \"moves\": %lld, "
+            "\"p50_ms\": %.4f, \"p99_ms\": %.4f, \"max_ms\": %.4f}%s\n",
+            session->name, session->frames, (long long) session->moves,
+            percentile(session, 50) * 1000, percentile(session, 99) * 1000,
+            percentile(session, 100) * 1000,
+            i + 1 < session_count ? "," : "");
+        free(session->times);
+    }
+    fprintf(file, "  }\n}\n");
+    if (fclose(file) != 0) {
+        fprintf(stderr, "Failed to save %s: %s\n", output, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    printf("Saved %s\n", output);
+
+    // cleanup
+    stop_prefetch();
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroyWindow(window);
+    TTF_Quit();
+    SDL_Quit();
+    return EXIT_SUCCESS;
+}
@@ -11,190 +11,862 @@
 #include <stdbool.h>
 #include <limits.h>
 #include <errno.h>
+#include <string.h>
+#include <stdatomic.h>
 
+#include "commands.h"
 #include "generator.h"
+#include "image.h"
+#include "parallel.h"
+#include "profile.h"
 
-static const int WINDOW_WIDTH = 480;
+static const int WINDOW_WIDTH = 480; // initial size of the window
 static const int WINDOW_HEIGHT = 480;
-static const int SCALE = 6; // factor to scale-up artifact images by
+static const int SCALE = 6; // factor to scale-up 8x8 artifact images by
+static const int MAX_TILE = 128; // most pixels wide artifacts are zoomed to
 static const int FADE_TIME = 1000; // how long fading effect takes (ms)
 static const int PRE_FADE_TIME = 3000; // time before fading begins (ms)
+static const int FRAME_TIME = 1000 / 60; // time between frames of animation
+static const char *USAGE =
+    "usage: artifactor [-z SIZE] [-y SYMMETRY] [-v VERSION] [-l FILE]\n"
+    "       artifactor COMMAND [ARGS...]\n"
+    "Browses artifacts, or runs a command without opening a window.\n"
+    "  -l FILE      browse only the ids in a sorted binary id list (such as\n"
+    "               from artifactor mine -b) instead of all of them\n"
+    "  -z SIZE      size of the artifacts: 8, 16 or 32 (default: 8)\n"
+    "  -y SYMMETRY  symmetry of every artifact instead of the drawn one:\n"
+    "               d4, rot4 or point (default: drawn)\n"
+    "  -v VERSION   generator: v1 (default) or v2\n";
 // max # of digits (+null) for uint string
 #define MAX_DIGITS 11 
+// max length (+null) of an id with its version, like "v2:4294967295"
+#define MAX_NAMED_ID (MAX_DIGITS + 3)
+// rows the prefetcher may run ahead of the screen. grows with scroll speed
+#define MIN_LEAD 2
+#define MAX_LEAD 64
+#define LOOKAHEAD_MS 300 // how far ahead (in time) to prefetch at a speed
+#define PREFETCH_SLOTS MAX_LEAD // rows the prefetch queue can hold
+// scrolling by velocity. a held up/down key moves a row, then after a moment
+// scrolls on its own, faster the longer it's held
+#define HOLD_DELAY 300 // ms before a held key starts scrolling
+#define HOLD_SPEED 8.0 // rows per second it starts at
+#define HOLD_GROWTH 1.0225 // speed-up per frame (doubles in about 0.5 s)
+#define FLING_SPEED 1000.0 // rows per second of a fling (shift + up/down)
+#define FLING_BOOST 4.0 // speed-up of flinging again the same way
+#define FLING_DECAY 0.973 // slow-down per frame (halves in about 0.4 s)
+#define SETTLE_SPEED 8.0 // rows per second a scroll finishes its row at
+#define CROSSING_TIME 4 // seconds to scroll past every row at top speed
+#define PARALLEL_ROWS 4 // rows to generate at once that go on all cores
 
 static const SDL_Color COLOR_WHITE = {.r=255, .g=255, .b=255, .a=255};
 static const SDL_Color COLOR_RED = {.r=245, .g=0, .b=0, .a=255};
 static const SDL_Color COLOR_BLACK = {.r=0, .g=0, .b=0, .a=255};
 static const SDL_Color COLOR_GREEN = {.r=0, .g=245, .b=0, .a=255};
 
-typedef struct Artifact {
-    int id;
-    SDL_Texture *texture;
-    SDL_Surface *surface;
-} Artifact;
-
 static SDL_Renderer *renderer;
-static TTF_Font *font, *font_small;
-static Artifact *artifacts; // displayed artifacts buffer
-static int size; // size of artifacts
-static int cursorx, cursory; // artifact selection cursor on screen
+static SDL_Texture *atlas; // images of the buffered rows, one per ring slot
+static ArtifactFormat format = ARTIFACT_DEFAULT_FORMAT; // of the artifacts
+static int scale; // factor to scale-up artifact images by (zoom level)
+static int window_width, window_height; // size of the drawing area
+static uint32_t *row_pixels; // a row of artifact images, for uploading
+static SDL_Vertex *tile_vertices; // corners of the tiles on screen
+static int *tile_indices; // two triangles per tile, into tile_vertices
+static int ring_size; // rows of artifacts in the ring buffer
+static int64_t *ring_rows; // row held by each ring slot, or -1
+static const uint32_t *list; // ids browsed (mapped), or NULL for all ids
+static uint64_t list_count = (uint64_t) UINT_MAX + 1; // number of ids browsed
+static int64_t top; // row shown at the top of the screen
+static int64_t last_row; // row of the last id
+static int cursorx; // artifact selection cursor column
+static int64_t cursory; // artifact selection cursor row
 static int rows, cols; // rows and columns of artifacts on screen at a time
-static int onscreen_offset; // index into artifacts where onscreen ones begin
 static int xoff, yoff; // rendering offset for artifacts grid
 static char input[MAX_DIGITS]; // for input ID to jump to
-static char selected[MAX_DIGITS]; // current ID
+static char selected[MAX_NAMED_ID]; // current ID
 static int input_fade = -1; // text fade animation time started
 static SDL_Color input_color; // text color
+static bool dirty = true; // whether the screen needs rendering again
+static double scroll_pos; // top row with the fraction of it scrolled past
+static double scroll_velocity; // rows per second, negative going up
+static int scroll_held; // 1 while down is held, -1 for up, else 0
+static bool flinging; // whether the scroll is slowing down by itself
+static Uint32 next_step; // when the scroll next moves, a frame at a time
+static uint32_t *screen_pixels; // rows of a screen, generated together
+static Encoder encoder; // for saving artifacts
+#ifdef PROFILE
+static bool show_profile; // whether to draw the profiling overlay
+#endif
+
+// characters in the glyph caches, printable ascii
+#define FIRST_GLYPH ' '
+#define LAST_GLYPH '~'
+#define GLYPH_COUNT (LAST_GLYPH - FIRST_GLYPH + 1)
+
+/* text rendered once into a texture, so it can be drawn without rendering 
+ * text every frame.
+ */
+typedef struct GlyphAtlas {
+    SDL_Texture *texture; // white glyphs, tinted when drawn
+    SDL_Rect glyphs[GLYPH_COUNT]; // where each character is in the texture
+    int height;
+} GlyphAtlas;
+
+static GlyphAtlas text, text_small;
+
+/* a row generated ahead of time by the prefetch thread. */
+typedef struct PrefetchRow {
+    int64_t row;
+    int epoch; // prediction it was made for
+    uint32_t *pixels;
+} PrefetchRow;
+
+// single producer (prefetch thread), single consumer (main thread) queue
+static PrefetchRow prefetch_queue[PREFETCH_SLOTS];
+static atomic_uint prefetch_head; // next slot to take, written by consumer
+static atomic_uint prefetch_tail; // next slot to fill, written by producer
+// the prediction, written by the main thread. a new epoch means the old 
+// prefetched rows are useless (direction changed, or jumped)
+static atomic_int prefetch_epoch;
+static atomic_int prefetch_dir; // 1 = down, -1 = up
+static atomic_int prefetch_lead; // rows to stay ahead of the screen by
+static _Atomic int64_t prefetch_from; // first row past the screen edge
+static atomic_bool prefetch_running;
+static SDL_sem *prefetch_wake;
+static SDL_Thread *prefetch_thread;
+static Uint32 prefetch_event; // sent by the prefetch thread when rows are ready
+static float scroll_speed; // rows per second, smoothed
+static Uint32 last_scroll; // time of last scroll
+
+/* returns the id at the given position of the grid (of the browsed ids). 
+ * any position is just arithmetic, even in a mapped list.
+ */
+static uint32_t id_at(int64_t pos) {
+    return list != NULL ? list[pos] : (uint32_t) pos;
+}
+
+/* returns the rows on screen, counting one partly scrolled in. */
+static int shown_rows() {
+    return scroll_pos > top ? rows + 1 : rows;
+}
+
+/* returns the ring slot for the given row. */
+static int ring_slot(int64_t row) {
+    return row % ring_size;
+}
 
-/* generates a new Artifact (images for SDL usage). */
-static Artifact generate_artifact_SDL(int id) {
+/* generates the artifacts of the given row as pixels, cols images wide. */
+static void render_row(int64_t row, uint32_t *out) {
     #if SDL_BYTEORDER == SDL_BIG_ENDIAN
-        const uint32_t R_MASK = 0xff000000;
-        const uint32_t G_MASK = 0x00ff0000;
-        const uint32_t B_MASK = 0x0000ff00;
         const uint32_t A_MASK = 0x000000ff;
     #else
-        const uint32_t R_MASK = 0x000000ff;
-        const uint32_t G_MASK = 0x0000ff00;
-        const uint32_t B_MASK = 0x00ff0000;
         const uint32_t A_MASK = 0xff000000;
     #endif
+    const int area = format.size * format.size;
+    const int pitch = cols * format.size; // pixels per row of out
+    PROFILE_SCOPE("render_row");
 
-    Artifact artifact = {.id = id};
-    artifact.surface = SDL_CreateRGBSurface(0, GENERATED_SIZE, GENERATED_SIZE, 
-        32, R_MASK, G_MASK, B_MASK, A_MASK);
-    int* pixels = (int*) artifact.surface->pixels;
-    generate_artifact(pixels, id);
-    // apply alpha mask, ensure non-zero pixels have a=255
-    for (int i = 0; i < GENERATED_SIZE * GENERATED_SIZE; i++) {
-        if (pixels[i] != 0) pixels[i] |= A_MASK;
+    // rows can be thousands of artifacts wide, so go a batch at a time
+    uint32_t pixels[ARTIFACT_BATCH_LANES * ARTIFACT_MAX_SIZE 
+        * ARTIFACT_MAX_SIZE];
+    int64_t first = row * cols;
+    // only generate ids in range. cells outside are left empty
+    int start = first < 0 ? -first : 0;
+    int end = first + cols > (int64_t) list_count ? list_count - first : cols;
+    memset(out, 0, sizeof(uint32_t) * pitch * format.size);
+    if (start < end) PROFILE_COUNT(PROFILE_TILES, end - start);
+    int i = start;
+    while (i < end) {
+        // consecutive ids are generated together (all of them, unless 
+        // browsing a list)
+        uint32_t id = id_at(first + i);
+        int n = 1;
+        while (n < ARTIFACT_BATCH_LANES && i + n < end 
+        && id_at(first + i + n) == id + n) n++;
+        // apply alpha mask, ensure non-zero pixels have a=255
+        generate_artifacts_rgba(pixels, id, n, &format, A_MASK);
+        for (int j = 0; j < n; j++) {
+            for (int y = 0; y < format.size; y++) {
+                memcpy(out + y * pitch + (i + j) * format.size, 
+                    pixels + j * area + y * format.size, 
+                    sizeof(uint32_t) * format.size);
+            }
+        }
+        i += n;
     }
-    artifact.texture = SDL_CreateTextureFromSurface(renderer, artifact.surface);
-    return artifact;
 }
 
-/* frees resources of no-longer visible artifact. */
-static void free_artifact(Artifact *artifact) {
-    SDL_FreeSurface(artifact->surface);
-    SDL_DestroyTexture(artifact->texture);
+/* uploads pixels of the given row into its ring slot of the atlas. */
+static void upload_row(int64_t row, const uint32_t *pixels) {
+    const int pitch = cols * format.size;
+    PROFILE_SCOPE("upload_row");
+    PROFILE_COUNT(PROFILE_UPLOADS, 1);
+    int slot = ring_slot(row);
+    SDL_Rect rect = {.x = 0, .y = slot * format.size, 
+        .w = pitch, .h = format.size};
+    SDL_UpdateTexture(atlas, &rect, pixels, sizeof(uint32_t) * pitch);
+    ring_rows[slot] = row;
 }
 
-/* updates selected artifact id string. */
-static void update_selected() {
-    uint32_t id = cursorx + cursory * cols;
-    snprintf(selected, MAX_DIGITS, "%u", id);
+/* generates the artifacts of the given row into its atlas row. */
+static void generate_row_SDL(int64_t row) {
+    render_row(row, row_pixels);
+    upload_row(row, row_pixels);
 }
 
-/* moves the displayed rows of artifacts down (false) or up (true). */
-static void shift_rows(bool up_vs_down) {
-    int first_id = artifacts[0].id;
-    if (up_vs_down) {
-        // remove shifted-out artifacts
-        for (int i = 0; i < onscreen_offset; i++) {
-            free_artifact(&artifacts[i]);
+/* prefetch thread. generates rows past the edge of the screen, in the 
+ * direction it is scrolling, so the main thread only has to upload them.
+ */
+static int prefetch_rows(void *data) {
+    int epoch = -1;
+    int64_t next = 0; // next row to generate
+    while (atomic_load(&prefetch_running)) {
+        SDL_SemWait(prefetch_wake);
+        int generated = 0;
+        while (atomic_load(&prefetch_running)) {
+            int e = atomic_load(&prefetch_epoch);
+            int dir = atomic_load(&prefetch_dir);
+            int64_t from = atomic_load(&prefetch_from);
+            if (e != epoch) {
+                epoch = e;
+                next = from;
+            }
+            // don't fall behind the screen, or get too far ahead of it
+            if ((next - from) * dir < 0) next = from;
+            if ((next - from) * dir >= atomic_load(&prefetch_lead)) break;
+            if (next < 0 || next > last_row) break;
+
+            unsigned tail = atomic_load_explicit(&prefetch_tail, 
+                memory_order_relaxed);
+            unsigned head = atomic_load_explicit(&prefetch_head, 
+                memory_order_acquire);
+            if (tail - head >= PREFETCH_SLOTS) break; // full
+            PrefetchRow *slot = &prefetch_queue[tail % PREFETCH_SLOTS];
+            render_row(next, slot->pixels);
+            slot->row = next;
+            slot->epoch = epoch;
+            atomic_store_explicit(&prefetch_tail, tail + 1, 
+                memory_order_release);
+            next += dir;
+            generated++;
         }
-        // shift up artifacts
-        for (int i = 0; i < onscreen_offset + rows * cols; i++) {
-            artifacts[i] = artifacts[i + cols];
+        if (generated > 0) {
+            // wake up the main thread to take them
+            SDL_Event event = {.type = prefetch_event};
+            SDL_PushEvent(&event);
         }
-        // generate next artifacts offscreen
-        for (int i = 0; i < onscreen_offset; i++) {
-            int index = onscreen_offset + rows * cols + i;
-            int id = first_id + index + onscreen_offset;
-            artifacts[index] = generate_artifact_SDL(id);
+    }
+    return 0;
+}
+
+/* uploads the rows the prefetch thread has generated, if still useful. */
+static void take_prefetched() {
+    unsigned head = atomic_load_explicit(&prefetch_head, 
+        memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&prefetch_tail, 
+        memory_order_acquire);
+    if (head == tail) return;
+    PROFILE_SCOPE("take_prefetched");
+    int epoch = atomic_load(&prefetch_epoch);
+    int dir = atomic_load(&prefetch_dir);
+    const int shown = shown_rows();
+    for (; head != tail; head++) {
+        PrefetchRow *p = &prefetch_queue[head % PREFETCH_SLOTS];
+        int64_t held = ring_rows[ring_slot(p->row)];
+        // don't replace rows on screen, or upload ones it has scrolled past
+        if (p->epoch != epoch || held == p->row 
+        || (held >= top && held < top + shown)
+        || (dir > 0 ? p->row < top : p->row >= top + shown)) continue;
+        upload_row(p->row, p->pixels);
+    }
+    atomic_store_explicit(&prefetch_head, head, memory_order_release);
+    SDL_SemPost(prefetch_wake); // room for more
+}
+
+/* updates the prediction of where the screen is going, from a scroll of 
+ * delta rows.
+ */
+static void predict(int64_t delta) {
+    int dir = atomic_load(&prefetch_dir);
+    if (delta <= -rows || delta >= rows) {
+        // jumped. whatever was fetched is for somewhere else
+        scroll_speed = 0;
+        atomic_fetch_add(&prefetch_epoch, 1);
+    } else if (delta != 0) {
+        Uint32 now = SDL_GetTicks();
+        Uint32 dt = now - last_scroll;
+        if (dt < 1) dt = 1;
+        float speed = (delta < 0 ? -delta : delta) * 1000.0f / dt;
+        if (dt > LOOKAHEAD_MS) speed = 0; // started again from still
+        scroll_speed = (scroll_speed + speed) / 2;
+        last_scroll = now;
+        if ((delta > 0) != (dir > 0)) {
+            dir = -dir;
+            atomic_store(&prefetch_dir, dir);
+            atomic_fetch_add(&prefetch_epoch, 1);
         }
+    }
+    int lead = MIN_LEAD + scroll_speed * LOOKAHEAD_MS / 1000;
+    atomic_store(&prefetch_lead, lead > MAX_LEAD ? MAX_LEAD : lead);
+    atomic_store(&prefetch_from, dir > 0 ? top + shown_rows() : top - 1);
+    SDL_SemPost(prefetch_wake);
+}
+
+/* like predict(), while scrolling by velocity. the rows it scrolls past 
+ * before the next frame are never shown, so the prefetch thread skips them
+ * and generates the ones that frame shows.
+ *
+ * next - row at the top of the screen in the next frame
+ */
+static void predict_velocity(int64_t next) {
+    int dir = scroll_velocity > 0 ? 1 : -1;
+    if (dir != atomic_load(&prefetch_dir)) {
+        atomic_store(&prefetch_dir, dir);
+        atomic_fetch_add(&prefetch_epoch, 1);
+    }
+    scroll_speed = scroll_velocity * dir;
+    last_scroll = SDL_GetTicks();
+    int64_t from = dir > 0 ? top + shown_rows() : top - 1;
+    if (dir > 0 && next > from) from = next;
+    if (dir < 0 && next + rows < from) from = next + rows;
+    int lead = MIN_LEAD + scroll_speed * LOOKAHEAD_MS / 1000;
+    if (lead > MAX_LEAD) lead = MAX_LEAD;
+    // past a screen a frame, rows after the next frame's are skipped too
+    if (scroll_speed * FRAME_TIME / 1000 > rows && lead > rows + 1) {
+        lead = rows + 1;
+    }
+    atomic_store(&prefetch_lead, lead);
+    atomic_store(&prefetch_from, from);
+    SDL_SemPost(prefetch_wake);
+}
+
+/* renders the characters of the given font into a glyph cache. */
+static void build_glyphs(GlyphAtlas *cache, const char *path, int size) {
+    static const SDL_Color WHITE = {.r=255, .g=255, .b=255, .a=255};
+
+    TTF_Font *font = TTF_OpenFont(path, size);
+    if (font == NULL) {
+        fprintf(stderr, "Failed to load font: %s\n", TTF_GetError());
+        exit(EXIT_FAILURE);
+    }
+    char chars[GLYPH_COUNT + 1];
+    for (int i = 0; i < GLYPH_COUNT; i++) chars[i] = FIRST_GLYPH + i;
+    chars[GLYPH_COUNT] = '\0';
+    SDL_Surface *surface = TTF_RenderText_Blended(font, chars, WHITE);
+    if (surface == NULL) {
+        fprintf(stderr, "Failed to render font: %s\n", TTF_GetError());
+        exit(EXIT_FAILURE);
+    }
+    cache->texture = SDL_CreateTextureFromSurface(renderer, surface);
+    SDL_SetTextureBlendMode(cache->texture, SDL_BLENDMODE_BLEND);
+    cache->height = surface->h;
+
+    // find each glyph from the width of the characters before it
+    int x = 0;
+    for (int i = 0; i < GLYPH_COUNT; i++) {
+        int end;
+        char prefix = chars[i + 1];
+        chars[i + 1] = '\0';
+        TTF_SizeText(font, chars, &end, NULL);
+        chars[i + 1] = prefix;
+        cache->glyphs[i] = (SDL_Rect) {.x = x, .y = 0, .w = end - x, 
+            .h = surface->h};
+        x = end;
+    }
+    SDL_FreeSurface(surface);
+    TTF_CloseFont(font);
+}
+
+/* returns the glyph of the given character, or NULL if it has none. */
+static const SDL_Rect *glyph(const GlyphAtlas *cache, char c) {
+    if (c < FIRST_GLYPH || c > LAST_GLYPH) return NULL;
+    return &cache->glyphs[c - FIRST_GLYPH];
+}
+
+/* returns the width of the given string drawn from the glyph cache. */
+static int text_width(const GlyphAtlas *cache, const char *str) {
+    int width = 0;
+    for (; *str; str++) {
+        const SDL_Rect *src = glyph(cache, *str);
+        if (src != NULL) width += src->w;
+    }
+    return width;
+}
+
+/* draws the given string from the glyph cache in the given color. */
+static void draw_text(const GlyphAtlas *cache, const char *str, int x, 
+int y, SDL_Color color) {
+    SDL_SetTextureColorMod(cache->texture, color.r, color.g, color.b);
+    SDL_SetTextureAlphaMod(cache->texture, color.a);
+    SDL_Rect dst = {.x = x, .y = y, .h = cache->height};
+    for (; *str; str++) {
+        const SDL_Rect *src = glyph(cache, *str);
+        if (src == NULL) continue;
+        dst.w = src->w;
+        SDL_RenderCopy(renderer, cache->texture, src, &dst);
+        dst.x += dst.w;
+    }
+}
+
+/* updates selected artifact id string. */
+static void update_selected() {
+    uint32_t id = id_at(cursorx + cursory * cols);
+    // ids of other versions than v1 name different artifacts
+    if (format.version == ARTIFACT_V1) {
+        snprintf(selected, MAX_NAMED_ID, "%u", id);
     } else {
-        // remove shifted-out artifacts
-        for (int i = 0; i < onscreen_offset; i++) {
-            int index = i + onscreen_offset + rows * cols;
-            free_artifact(&artifacts[index]);
-        }
-        // shift down artifacts
-        for (int i = size - 1; i >= onscreen_offset; i--) {
-            artifacts[i] = artifacts[i - cols];
-        }
-        // generate next artifacts offscreen
-        for (int i = 0; i < onscreen_offset; i++) {
-            int id = first_id - onscreen_offset + i;
-            artifacts[i] = generate_artifact_SDL(id);
-        }
+        snprintf(selected, MAX_NAMED_ID, "%s:%u", 
+            artifact_version_name(format.version), id);
+    }
+    dirty = true;
+}
+
+/* generates rows [start, start + count) of screen_rows into screen_pixels,
+ * on a worker of fill_screen().
+ */
+static void render_screen_rows(void *ctx, uint64_t start, uint64_t count,
+        int worker) {
+    const int64_t *screen_rows = ctx;
+    const size_t area = (size_t) cols * format.size * format.size;
+    for (uint64_t i = start; i < start + count; i++) {
+        render_row(screen_rows[i], screen_pixels + i * area);
+    }
+}
+
+/* puts every row on screen in the buffer. rows still in it are kept, 
+ * prefetched ones are uploaded, and only the rest are generated here, on all
+ * cores if there are many (after a jump, or scrolling past a whole screen 
+ * in a frame).
+ */
+static void fill_screen() {
+    take_prefetched();
+    int64_t screen_rows[rows + 1];
+    int missing = 0;
+    for (int64_t row = top; row < top + shown_rows(); row++) {
+        if (ring_rows[ring_slot(row)] != row) screen_rows[missing++] = row;
+    }
+    if (missing < PARALLEL_ROWS) {
+        for (int i = 0; i < missing; i++) generate_row_SDL(screen_rows[i]);
+        return;
+    }
+    PROFILE_SCOPE("fill_screen");
+    const size_t area = (size_t) cols * format.size * format.size;
+    parallel_for(missing, 1, 0, render_screen_rows, screen_rows);
+    for (int i = 0; i < missing; i++) {
+        upload_row(screen_rows[i], screen_pixels + i * area);
+    }
+}
+
+/* scrolls the screen so the given row is at its top. */
+static void scroll_to(int64_t new_top) {
+    PROFILE_SCOPE("scroll_to");
+    int64_t delta = new_top - top;
+    if (delta != 0 || scroll_pos != new_top) dirty = true;
+    top = new_top;
+    scroll_pos = new_top;
+    predict(delta);
+    fill_screen();
+}
+
+/* returns whether the cursor is on a valid id. */
+static bool cursor_in_range() {
+    return cursorx + cursory * cols < (int64_t) list_count;
+}
+
+/* returns the last row that can be at the top of the screen. */
+static int64_t max_top() {
+    int64_t max = last_row - rows + 1;
+    return max > 0 ? max : 0;
+}
+
+/* scrolls to keep the cursor centered, until at the ends of the list. */
+static void follow_cursor() {
+    int64_t new_top = cursory - rows / 2;
+    if (new_top > max_top()) new_top = max_top();
+    if (new_top < 0) new_top = 0;
+    scroll_to(new_top);
+}
+
+/* returns whether the screen is scrolling by velocity, or a key is held that
+ * will make it.
+ */
+static bool scrolling() {
+    return scroll_velocity != 0 || scroll_held != 0;
+}
+
+/* stops scrolling by velocity, wherever the screen is. */
+static void stop_scroll() {
+    scroll_velocity = 0;
+    scroll_held = 0;
+    flinging = false;
+}
+
+/* returns the fastest the screen scrolls, in rows per second. */
+static double top_speed() {
+    double speed = (double) (last_row + 1) / CROSSING_TIME;
+    return speed > FLING_SPEED ? speed : FLING_SPEED;
+}
+
+/* starts holding the up (-1) or down (1) key. */
+static void hold(int dir) {
+    stop_scroll();
+    scroll_held = dir;
+    next_step = SDL_GetTicks() + HOLD_DELAY;
+}
+
+/* lets go of the up (-1) or down (1) key. the scroll finishes its row. */
+static void let_go(int dir) {
+    if (scroll_held != dir) return;
+    scroll_held = 0;
+    if (scroll_velocity != 0) scroll_velocity = dir * SETTLE_SPEED;
+}
+
+/* flings the screen up (-1) or down (1), to slow down by itself. flinging
+ * it again the same way before then speeds it up.
+ */
+static void fling(int dir) {
+    double speed = FLING_SPEED;
+    if (flinging && scroll_velocity * dir > 0) {
+        speed = scroll_velocity * dir * FLING_BOOST;
     }
+    if (speed > top_speed()) speed = top_speed();
+    if (scroll_velocity == 0) next_step = SDL_GetTicks();
+    scroll_held = 0;
+    flinging = true;
+    scroll_velocity = dir * speed;
 }
 
-/* jumps directly to the artifact with the given id. */
-static void jump(uint32_t id) {
-    int row = id / cols;
-    int col = id % cols;
-    cursorx = col;
-    if (cursory == row) return; // already here!
-    cursory = row;
+/* moves the screen to the given row (and fraction of it) at its top, taking
+ * the cursor along.
+ */
+static void glide_to(double pos) {
+    PROFILE_SCOPE("glide_to");
+    const int64_t new_top = pos;
+    cursory += new_top - top;
+    if (cursory < 0) cursory = 0;
+    if (cursory > last_row) cursory = last_row;
+    while (!cursor_in_range()) cursorx--;
+    top = new_top;
+    scroll_pos = pos;
+    dirty = true;
+    if (scroll_velocity != 0) {
+        double next = pos + scroll_velocity * FRAME_TIME / 1000;
+        if (next < 0) next = 0;
+        if (next > max_top()) next = max_top();
+        predict_velocity(next);
+    } else {
+        predict(0);
+    }
+    fill_screen();
     update_selected();
+}
+
+/* returns how long until the scroll next moves (ms), or -1 if it won't. */
+static int scroll_wait() {
+    if (!scrolling()) return -1;
+    int wait = (int) (next_step - SDL_GetTicks());
+    return wait > 0 ? wait : 0;
+}
+
+/* moves the screen by a frame at the scroll's velocity, once it's time. 
+ * frames move it as if they were exactly FRAME_TIME apart, so the prefetch 
+ * thread knows where the next one will be.
+ */
+static void update_scroll() {
+    Uint32 now = SDL_GetTicks();
+    if (!scrolling() || (int) (now - next_step) < 0) return;
+    // don't try to catch up on frames that took too long
+    next_step = (int) (now - next_step) >= FRAME_TIME ? now + FRAME_TIME 
+        : next_step + FRAME_TIME;
+    if (scroll_held != 0) {
+        // faster the longer it's held
+        double speed = scroll_velocity * scroll_held;
+        speed = speed < HOLD_SPEED ? HOLD_SPEED : speed * HOLD_GROWTH;
+        if (speed > top_speed()) speed = top_speed();
+        scroll_velocity = scroll_held * speed;
+    } else if (flinging) {
+        scroll_velocity *= FLING_DECAY;
+    }
+    const int dir = scroll_velocity > 0 ? 1 : -1;
+    if (flinging && scroll_velocity * dir < SETTLE_SPEED) {
+        flinging = false;
+        scroll_velocity = dir * SETTLE_SPEED;
+    }
 
-    const int crow = onscreen_offset + cols * (cols / 2); // tiles to center row
-    if (id < crow) {
-        // appears in top edge of screen
-        for (int i = onscreen_offset; i < size; i++) {
-            free_artifact(&artifacts[i]);
-            artifacts[i] = generate_artifact_SDL(i - onscreen_offset);
+    double pos = scroll_pos + scroll_velocity * FRAME_TIME / 1000;
+    if (scroll_held == 0 && !flinging) {
+        // settle at the start of the next row
+        const int64_t row = scroll_pos;
+        const double stop = dir > 0 && row != scroll_pos ? row + 1 : row;
+        if ((pos - stop) * dir >= 0) {
+            pos = stop;
+            scroll_velocity = 0;
         }
-    } else if (id >= UINT_MAX - crow) {
-        // appears in bottom edge of screen
-        for (int i = 0; i < size - onscreen_offset; i++) {
-            free_artifact(&artifacts[i]);
-            artifacts[i] = generate_artifact_SDL(i + UINT_MAX - size);
+    }
+    if (pos <= 0 || pos >= max_top()) {
+        pos = pos <= 0 ? 0 : max_top();
+        scroll_velocity = 0;
+        flinging = false;
+    }
+    glide_to(pos);
+}
+
+/* moves the cursor, and the screen with it, a screen up (-1) or down (1). */
+static void page(int dir) {
+    stop_scroll();
+    cursory += dir * rows;
+    if (cursory < 0) cursory = 0;
+    if (cursory > last_row) cursory = last_row;
+    while (!cursor_in_range()) cursorx--;
+    follow_cursor();
+    update_selected();
+}
+
+/* returns the position of the given id in the grid, or of the id after it
+ * if a browsed list doesn't have it.
+ */
+static int64_t find(uint32_t id) {
+    if (list == NULL) return id;
+    // binary search, only touching the pages on the way
+    uint64_t lo = 0;
+    uint64_t hi = list_count;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (list[mid] < id) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo < list_count ? lo : list_count - 1;
+}
+
+/* jumps directly to the artifact with the given id, or the nearest one 
+ * after it. returns whether it has the id.
+ */
+static bool jump(uint32_t id) {
+    stop_scroll();
+    int64_t pos = find(id);
+    int64_t row = pos / cols;
+    cursorx = pos % cols;
+    if (cursory != row || scroll_pos != top) { // else already here!
+        cursory = row;
+        follow_cursor();
+    }
+    update_selected();
+    return id_at(pos) == id;
+}
+
+/* starts the prefetch thread. */
+static void start_prefetch() {
+    atomic_store(&prefetch_running, true);
+    prefetch_thread = SDL_CreateThread(prefetch_rows, "prefetch", NULL);
+}
+
+/* stops the prefetch thread, dropping whatever it had queued. */
+static void stop_prefetch() {
+    atomic_store(&prefetch_running, false);
+    SDL_SemPost(prefetch_wake);
+    SDL_WaitThread(prefetch_thread, NULL);
+    prefetch_thread = NULL;
+    atomic_store(&prefetch_head, 0);
+    atomic_store(&prefetch_tail, 0);
+}
+
+/* allocates memory, exiting if there is none. */
+static void *alloc(size_t size) {
+    void *p = malloc(size);
+    if (p == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    return p;
+}
+
+/* fits the grid of artifacts to the drawing area at the current scale, 
+ * resizing the buffers of rows to match. keeps the selected artifact.
+ */
+static void layout() {
+    PROFILE_SCOPE("layout");
+    int64_t pos = cursorx + cursory * cols; // of the selected artifact
+    stop_scroll();
+    if (prefetch_thread != NULL) stop_prefetch();
+    free(row_pixels);
+    free(screen_pixels);
+    free(ring_rows);
+    free(tile_vertices);
+    free(tile_indices);
+    for (int i = 0; i < PREFETCH_SLOTS; i++) free(prefetch_queue[i].pixels);
+    if (atlas != NULL) SDL_DestroyTexture(atlas);
+
+    // populate view with artifacts (+2 to allow for spacings), zooming out
+    // if the window is too small for even one
+    SDL_GetRendererOutputSize(renderer, &window_width, &window_height);
+    while (scale > 1 && (window_width < format.size * scale + 2 
+    || window_height < format.size * scale + 2)) scale--;
+    const int tile = format.size * scale;
+    cols = window_width / (tile + 2);
+    rows = window_height / (tile + 2);
+    if (cols < 1) cols = 1;
+    if (rows < 1) rows = 1;
+    // room for the screen (and a row scrolled partly in), plus the most
+    // prefetched rows either way. the atlas holds them all, as far as the 
+    // renderer allows
+    ring_size = rows + 1 + MAX_LEAD * 2;
+    SDL_RendererInfo info;
+    if (SDL_GetRendererInfo(renderer, &info) == 0 
+    && info.max_texture_height > 0) {
+        int most = info.max_texture_height / format.size;
+        if (ring_size > most) ring_size = most;
+        if (rows > ring_size - 1) rows = ring_size - 1;
+    }
+    last_row = (list_count - 1) / cols;
+    xoff = (window_width - ((tile + 1) * cols)) / 2;
+    yoff = (window_height - ((tile + 1) * rows)) / 2;
+
+    const size_t row_bytes = sizeof(uint32_t) * cols * format.size 
+        * format.size;
+    row_pixels = alloc(row_bytes);
+    screen_pixels = alloc(row_bytes * (rows + 1));
+    ring_rows = alloc(sizeof(int64_t) * ring_size);
+    for (int i = 0; i < ring_size; i++) ring_rows[i] = -1;
+    for (int i = 0; i < PREFETCH_SLOTS; i++) {
+        prefetch_queue[i].pixels = alloc(row_bytes);
+    }
+    atlas = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, 
+        SDL_TEXTUREACCESS_STREAMING, cols * format.size, 
+        ring_size * format.size);
+    if (atlas == NULL) {
+        fprintf(stderr, "Failed to create atlas: %s\n", SDL_GetError());
+        exit(EXIT_FAILURE);
+    }
+    SDL_SetTextureBlendMode(atlas, SDL_BLENDMODE_BLEND);
+
+    // the tiles stay in place, only the atlas rows they show (and how far 
+    // they're scrolled) change
+    const int tiles = (rows + 1) * cols;
+    tile_vertices = alloc(sizeof(SDL_Vertex) * 4 * tiles);
+    tile_indices = alloc(sizeof(int) * 6 * tiles);
+    for (int i = 0; i < tiles; i++) {
+        float x = (i % cols) * (tile + 1) + xoff;
+        float y = (i / cols) * (tile + 1) + yoff;
+        float u = (float) (i % cols) / cols;
+        SDL_Vertex *v = &tile_vertices[i * 4];
+        // top left, top right, bottom left, bottom right
+        for (int k = 0; k < 4; k++) {
+            v[k].position.x = x + (k & 1) * tile;
+            v[k].position.y = y + (k >> 1) * tile;
+            v[k].color = COLOR_WHITE;
+            v[k].tex_coord.x = u + (k & 1) * 1.0f / cols;
         }
-    } else {
-        // load in artifact view centered on target
-        for (int i = 0; i < size; i++) {
-            free_artifact(&artifacts[i]);
-            artifacts[i] = generate_artifact_SDL(id + i - crow - col);
+        static const int CORNERS[6] = {0, 1, 2, 1, 3, 2};
+        for (int k = 0; k < 6; k++) {
+            tile_indices[i * 6 + k] = i * 4 + CORNERS[k];
         }
     }
+
+    // start again around the selected artifact
+    atomic_fetch_add(&prefetch_epoch, 1);
+    start_prefetch();
+    cursorx = pos % cols;
+    cursory = pos / cols;
+    update_selected();
+    top = -rows; // nothing in the ring is on screen
+    follow_cursor();
+}
+
+/* zooms in or out by the given number of steps, as far as the window fits 
+ * at least one artifact.
+ */
+static void zoom(int steps) {
+    int new_scale = scale + steps;
+    if (new_scale < 1) new_scale = 1;
+    if (new_scale > MAX_TILE / format.size) new_scale = MAX_TILE / format.size;
+    if (new_scale == scale) return;
+    scale = new_scale;
+    layout();
 }
 
 static void init() {
-    // populate view with artifacts (+2 to allow for spacings)
-    cols = (WINDOW_WIDTH / (GENERATED_SIZE * SCALE + 2));//
-    rows = (WINDOW_HEIGHT / (GENERATED_SIZE * SCALE + 2));
-    int offscreen = cols * 2;
-    size = cols * rows + offscreen;
-    artifacts = malloc(sizeof(Artifact) * size);
-    onscreen_offset = offscreen / 2;
-    xoff = (WINDOW_WIDTH - ((GENERATED_SIZE * SCALE + 1) * cols)) / 2;
-    yoff = (WINDOW_HEIGHT - ((GENERATED_SIZE * SCALE + 1) * rows)) / 2;
+    // keep them around the same size on screen, whatever their size
+    scale = (GENERATED_SIZE * SCALE + format.size - 1) / format.size;
+    prefetch_event = SDL_RegisterEvents(1);
+    prefetch_wake = SDL_CreateSemaphore(0);
+    atomic_store(&prefetch_dir, 1); // start prefetching, heading down
     cursorx = 0;
     cursory = 0;
-    update_selected();
+    layout();
 
-    // generate artifacts
-    for (int i = 0; i < size; i++) {
-        artifacts[i] = generate_artifact_SDL(i - onscreen_offset);
-    }
+    // init text
+    build_glyphs(&text, "FreeMonoBold.ttf", 24);
+    build_glyphs(&text_small, "FreeMonoBold.ttf", 18);
+}
 
-    // init font
-    font = TTF_OpenFont("FreeMonoBold.ttf", 24);
-    if (font == NULL) {
-        fprintf(stderr, "Failed to load font: %s\n", TTF_GetError());
-        exit(EXIT_FAILURE);
+/* returns how long until the input text next changes by itself (ms), or -1
+ * if it won't.
+ */
+static int fade_wait() {
+    if (input_fade == -1) return -1;
+    int elapsed = SDL_GetTicks() - input_fade;
+    if (elapsed < PRE_FADE_TIME) return PRE_FADE_TIME - elapsed;
+    return FRAME_TIME;
+}
+
+/* advances the input text fade animation. */
+static void update_fade() {
+    if (input_fade == -1) return;
+    int elapsed = SDL_GetTicks() - input_fade;
+    if (elapsed >= FADE_TIME + PRE_FADE_TIME) {
+        input_fade = -1;
+        dirty = true;
+    } else if (elapsed >= PRE_FADE_TIME) {
+        dirty = true;
     }
-    font_small = TTF_OpenFont("FreeMonoBold.ttf", 18);
 }
 
-/* receive key input. returns 1 if program should end. */
+/* waits for and receives key input. returns 1 if program should end. */
 static bool update() {
-    static const int input_size = 11; // 10 digits max (uint) + null byte
     static int input_i = 0; // index in input
 
-    if (input_fade != -1 
-    && SDL_GetTicks() - input_fade >= FADE_TIME + PRE_FADE_TIME) {
-        input_fade = -1;
-    }
-
+    // sleep until something happens, or the fade or scroll needs another
+    // frame
     SDL_Event event;
-    while (SDL_PollEvent(&event)) {
+    int wait = fade_wait();
+    int scroll = scroll_wait();
+    if (scroll >= 0 && (wait < 0 || scroll < wait)) wait = scroll;
+    int received = wait < 0 ? SDL_WaitEvent(&event) 
+        : SDL_WaitEventTimeout(&event, wait);
+    PROFILE_FRAME_BEGIN();
+    update_fade();
+    update_scroll();
+    if (!received) return 0;
+
+    do {
+        if (event.type == prefetch_event) {
+            take_prefetched();
+            continue;
+        }
         switch(event.type) {
             case SDL_QUIT:
                 return 1;
+            case SDL_WINDOWEVENT:
+                if (event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+                    layout();
+                }
+                // may need redrawing after being covered, etc.
+                dirty = true;
+                break;
+            case SDL_MOUSEWHEEL: {
+                // flings the screen, up when the wheel turns away
+                int y = event.wheel.y;
+                if (event.wheel.direction == SDL_MOUSEWHEEL_FLIPPED) y = -y;
+                if (y != 0) fling(y > 0 ? -1 : 1);
+                break;
+            }
+            case SDL_KEYUP:
+                switch (event.key.keysym.sym) {
+                    case SDLK_s:
+                    case SDLK_DOWN: let_go(1); break;
+                    case SDLK_w:
+                    case SDLK_UP: let_go(-1); break;
+                }
+                break;
             case SDL_KEYDOWN:
                 switch (event.key.keysym.sym) {
                     case SDLK_BACKSPACE: {
@@ -202,6 +874,7 @@ static bool update() {
                             input[input_i - 1] = '\0';
                             input_i--;
                             if (input_i == 0) input_fade = -1;
+                            dirty = true;
                         }
                         break;
                     }
@@ -220,12 +893,14 @@ static bool update() {
                             // reset input buffer for new number
                             input_i = 0;
                         }
-                        if (input_i >= input_size) break;
+                        // leave room for the null byte
+                        if (input_i >= MAX_DIGITS - 1) break;
                         input_color = COLOR_WHITE;
                         input_fade = SDL_GetTicks();
                         input[input_i] = event.key.keysym.sym;
                         input_i++;
                         input[input_i] = '\0';
+                        dirty = true;
                         break;
                     }
                     case SDLK_RETURN: {
@@ -237,44 +912,80 @@ static bool update() {
                                 // invalid number
                                 input_color = COLOR_RED;
                             } else {
-                                input_color = COLOR_GREEN;
-                                jump(id);
+                                // red if a browsed list doesn't have it
+                                input_color = jump(id) ? COLOR_GREEN 
+                                    : COLOR_RED;
                             }
                             input_fade = SDL_GetTicks() - PRE_FADE_TIME;
+                            // the next digit starts a new number, even in 
+                            // the same millisecond
+                            input_i = 0;
+                            dirty = true;
                         }
                         break;
                     }
                     case SDLK_x: {
-                        // save artifact to file
-                        uint32_t id = cursorx + cursory * cols;
-                        char buf[MAX_DIGITS + 4];
-                        snprintf(buf, MAX_DIGITS + 4, "%u.bmp", id);
+                        // save artifact to file, as big as it's shown
+                        uint32_t id = id_at(cursorx + cursory * cols);
+                        char buf[MAX_NAMED_ID + 4];
+                        if (format.version == ARTIFACT_V1) {
+                            snprintf(buf, sizeof(buf), "%u.png", id);
+                        } else {
+                            snprintf(buf, sizeof(buf), "%s-%u.png", 
+                                artifact_version_name(format.version), id);
+                        }
                         // don't overwrite existing file
                         if (access(buf, F_OK) == 0) break;
 
-                        int index = onscreen_offset + cursorx;
-                        if (cursory <= rows / 2) {
-                            index += (cursory % rows) * cols;
-                        } else if(cursory >= UINT_MAX / rows - rows / 2) {
-                            int middle = UINT_MAX / rows - rows / 2;
-                            index += (cursory - middle + rows / 2) * cols;
-                        } else {
-                            index += (rows / 2) * cols;
+                        uint32_t pixels[ARTIFACT_MAX_SIZE * ARTIFACT_MAX_SIZE];
+                        generate_artifacts_rgba(pixels, id, 1, &format, 
+                            IMAGE_ALPHA);
+                        Image image = {.width = format.size, 
+                            .height = format.size, .pixels = pixels};
+                        if (encode_image(&encoder, &image, scale, 
+                            IMAGE_PNG) == 0) {
+                            save_encoded(&encoder, buf);
                         }
-                        SDL_SaveBMP(artifacts[index].surface, buf);
                         break;
                     }
+                    case SDLK_v: {
+                        // browse the same ids by the next generator version
+                        if (prefetch_thread != NULL) stop_prefetch();
+                        format.version = (format.version + 1) 
+                            % ARTIFACT_VERSIONS;
+                        layout();
+                        break;
+                    }
+                    case SDLK_EQUALS:
+                    case SDLK_PLUS:
+                    case SDLK_KP_PLUS: {
+                        zoom(1);
+                        break;
+                    }
+                    case SDLK_MINUS:
+                    case SDLK_KP_MINUS: {
+                        zoom(-1);
+                        break;
+                    }
+                    #ifdef PROFILE
+                    case SDLK_F3: {
+                        // toggle profiling overlay
+                        show_profile = !show_profile;
+                        dirty = true;
+                        break;
+                    }
+                    #endif
                     case SDLK_d:
                     case SDLK_RIGHT: {
                         // move cursor right
                         cursorx++;
-                        if (cursorx >= cols) {
-                            if (cursory < UINT_MAX / rows) {
+                        if (cursorx >= cols || !cursor_in_range()) {
+                            if (cursory < last_row) {
                                 // wrap around to next row
                                 cursorx = 0;
                                 goto _MOVE_DOWN;
                             } else {
-                                cursorx = cols - 1;
+                                cursorx--;
                             }
                         }
                         update_selected();
@@ -296,30 +1007,48 @@ static bool update() {
                         update_selected();
                         break;
                     }
+                    case SDLK_PAGEDOWN: {
+                        page(1);
+                        break;
+                    }
+                    case SDLK_PAGEUP: {
+                        page(-1);
+                        break;
+                    }
                     case SDLK_s:
                     case SDLK_DOWN: {
+                        if (event.key.keysym.mod & KMOD_SHIFT) {
+                            fling(1);
+                            break;
+                        }
+                        // held down, it scrolls by itself instead of 
+                        // repeating
+                        if (event.key.repeat) break;
+                        hold(1);
                     _MOVE_DOWN:
                         // move cursor down
-                        if (cursory < UINT_MAX / rows) {
+                        if (cursory < last_row) {
                             cursory++;
-                            // cursor stays center until at end of page
-                            if (cursory > rows / 2
-                            && cursory <= UINT_MAX / rows - rows / 2) 
-                                shift_rows(true);
+                            // the last row may not be full
+                            while (!cursor_in_range()) cursorx--;
+                            follow_cursor();
                         }
                         update_selected();
                         break;
                     }
                     case SDLK_w:
                     case SDLK_UP: {
+                        if (event.key.keysym.mod & KMOD_SHIFT) {
+                            fling(-1);
+                            break;
+                        }
+                        if (event.key.repeat) break;
+                        hold(-1);
                     _MOVE_UP:
                         // move cursor up
                         if (cursory > 0) {
                             cursory--;
-                            // cursor stays center until at end of page
-                            if (cursory >= rows / 2
-                            && cursory < UINT_MAX / rows - rows / 2) 
-                                shift_rows(false);
+                            follow_cursor();
                         }
                         update_selected();
                         break;
@@ -327,103 +1056,187 @@ static bool update() {
                 }
                 break;
         }
-    }
+    } while (SDL_PollEvent(&event));
     return 0;
 }
 
+#ifdef PROFILE
+/* draws the times and counts of the last frame in the bottom left. */
+static void draw_profile() {
+    const ProfileStats *stats = profile_stats();
+    char lines[3][32];
+    snprintf(lines[0], sizeof(lines[0]), "frame %.2f ms", stats->frame_ms);
+    snprintf(lines[1], sizeof(lines[1]), "tiles %d", 
+        stats->counts[PROFILE_TILES]);
+    snprintf(lines[2], sizeof(lines[2]), "uploads %d", 
+        stats->counts[PROFILE_UPLOADS]);
+
+    SDL_Rect rect = {.x = 0, .w = 0, .h = text_small.height * 3 + 2};
+    rect.y = window_height - rect.h;
+    for (int i = 0; i < 3; i++) {
+        int width = text_width(&text_small, lines[i]) + 2;
+        if (width > rect.w) rect.w = width;
+    }
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 192);
+    SDL_RenderFillRect(renderer, &rect);
+    for (int i = 0; i < 3; i++) {
+        draw_text(&text_small, lines[i], 1, rect.y + 1 
+            + i * text_small.height, COLOR_GREEN);
+    }
+}
+#endif
+
 static void render() {
+    PROFILE_SCOPE("render");
     // clear screen
     SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
     SDL_RenderClear(renderer);
 
-    // draw artifacts
-    SDL_Rect rect;
-    rect.w = GENERATED_SIZE * SCALE;
-    rect.h = rect.w;
-    for (int i = 0; i < rows * cols; i++) {
-        Artifact *at = &artifacts[i + onscreen_offset];
-        rect.x = (i % cols) * (GENERATED_SIZE * SCALE + 1) + xoff;
-        rect.y = (i / cols) * (GENERATED_SIZE * SCALE + 1) + yoff;
-        SDL_RenderCopy(renderer, at->texture, NULL, &rect);
+    // draw artifacts, all from the atlas in one batch of triangles, moved
+    // up by however much of the top row is scrolled past
+    const int tile = format.size * scale;
+    const int shift = (scroll_pos - top) * (tile + 1);
+    const int shown = shown_rows();
+    SDL_Rect rect = {0, yoff, window_width, rows * (tile + 1)};
+    SDL_RenderSetClipRect(renderer, &rect);
+    {
+        PROFILE_SCOPE("draw_tiles");
+        for (int r = 0; r < shown; r++) {
+            int slot = ring_slot(top + r);
+            float v0 = (float) slot / ring_size;
+            float v1 = (float) (slot + 1) / ring_size;
+            float y = r * (tile + 1) + yoff - shift;
+            SDL_Vertex *v = &tile_vertices[r * cols * 4];
+            for (int i = 0; i < cols * 4; i += 4) {
+                v[i].tex_coord.y = v0;
+                v[i + 1].tex_coord.y = v0;
+                v[i + 2].tex_coord.y = v1;
+                v[i + 3].tex_coord.y = v1;
+                v[i].position.y = y;
+                v[i + 1].position.y = y;
+                v[i + 2].position.y = y + tile;
+                v[i + 3].position.y = y + tile;
+            }
+        }
+        SDL_RenderGeometry(renderer, atlas, tile_vertices, shown * cols * 4, 
+            tile_indices, shown * cols * 6);
     }
 
     // draw cursor
     SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
-    rect.w = GENERATED_SIZE * SCALE + 1;
+    rect.w = tile + 1;
     rect.h = rect.w;
     rect.x = cursorx * rect.w + xoff;
-    if (cursory >= rows / 2 && cursory <= UINT_MAX / rows - rows / 2) {
-        // keep centered correctly until at edges of list
-        rect.y = (rows / 2) * rect.h;
-    } else {
-        if (cursory < rows / 2) rect.y = cursory * rect.h;
-        else rect.y = (rows/2 + cursory - (UINT_MAX/rows - rows/2)) * rect.h;
-    }
-    rect.y += yoff;
+    rect.y = (cursory - top) * rect.h + yoff - shift;
     SDL_RenderDrawRect(renderer, &rect);
+    SDL_RenderSetClipRect(renderer, NULL);
 
     // draw input text
     if (input_fade != -1) {
-        if (SDL_GetTicks() - input_fade > PRE_FADE_TIME + FADE_TIME) {
-            input_color.a = 255 * (PRE_FADE_TIME + FADE_TIME 
-                - (SDL_GetTicks() - input_fade)) / FADE_TIME;
+        PROFILE_SCOPE("draw_input");
+        int elapsed = SDL_GetTicks() - input_fade;
+        if (elapsed > PRE_FADE_TIME) {
+            input_color.a = 255 * (PRE_FADE_TIME + FADE_TIME - elapsed) 
+                / FADE_TIME;
         }
-        SDL_Surface *surface = TTF_RenderText_Shaded(font, input, input_color,
-            COLOR_BLACK);
-        SDL_Texture *texture = SDL_CreateTextureFromSurface(renderer, surface);
-        rect.w = surface->w;
-        rect.h = surface->h;
-        rect.x = (WINDOW_WIDTH - rect.w) / 2;
-        rect.y = (WINDOW_HEIGHT - rect.h) / 2;
-        SDL_RenderCopy(renderer, texture, NULL, &rect);
-
-        // don't forget to free
-        SDL_FreeSurface(surface);
-        SDL_DestroyTexture(texture);
-    }
-    
-    { // draw selected artifact id
-        SDL_Surface *surface = TTF_RenderText_Solid(font_small, selected, 
-            COLOR_WHITE);
-        SDL_Texture *texture = SDL_CreateTextureFromSurface(renderer, surface);
-        rect.w = surface->w;
-        rect.h = surface->h;
-        rect.x = 1;
-        rect.y = 1;
-        SDL_RenderCopy(renderer, texture, NULL, &rect);
-
-        // don't forget to free
-        SDL_FreeSurface(surface);
-        SDL_DestroyTexture(texture);
+        rect.w = text_width(&text, input);
+        rect.h = text.height;
+        rect.x = (window_width - rect.w) / 2;
+        rect.y = (window_height - rect.h) / 2;
+        // text background, fading with the text
+        SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+        SDL_SetRenderDrawColor(renderer, COLOR_BLACK.r, COLOR_BLACK.g, 
+            COLOR_BLACK.b, input_color.a);
+        SDL_RenderFillRect(renderer, &rect);
+        draw_text(&text, input, rect.x, rect.y, input_color);
     }
 
+    // draw selected artifact id
+    draw_text(&text_small, selected, 1, 1, COLOR_WHITE);
+
+    #ifdef PROFILE
+        if (show_profile) draw_profile();
+    #endif
+
     // draw to screen
+    PROFILE_SCOPE("present");
     SDL_RenderPresent(renderer);
 }
 
-int main() {
+int main(int argc, char **argv) {
+    // headless modes don't need a window
+    if (argc > 1 && argv[1][0] != '-') return run_command(argc - 1, argv + 1);
+
+    const char *list_path = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "z:y:v:l:")) != -1) {
+        bool valid = true;
+        switch (opt) {
+            case 'z': 
+                valid = parse_positive(optarg, &format.size) 
+                    && artifact_size_supported(format.size);
+                break;
+            case 'y': 
+                format.symmetry = artifact_symmetry_by_name(optarg);
+                valid = format.symmetry >= 0;
+                break;
+            case 'v': 
+                format.version = artifact_version_by_name(optarg);
+                valid = format.version >= 0;
+                break;
+            case 'l': list_path = optarg; break;
+            default: valid = false; break;
+        }
+        if (!valid) {
+            fputs(USAGE, stderr);
+            return EXIT_FAILURE;
+        }
+    }
+    if (optind < argc) {
+        fputs(USAGE, stderr);
+        return EXIT_FAILURE;
+    }
+    if (list_path != NULL) {
+        list = map_id_list(list_path, &list_count);
+        if (list == NULL) return EXIT_FAILURE;
+    }
+
     // init
     SDL_Init(SDL_INIT_EVERYTHING);
     SDL_Window* window = SDL_CreateWindow("Artifactor", SDL_WINDOWPOS_UNDEFINED,
-        SDL_WINDOWPOS_UNDEFINED, WINDOW_WIDTH, WINDOW_HEIGHT, SDL_WINDOW_SHOWN);
+        SDL_WINDOWPOS_UNDEFINED, WINDOW_WIDTH, WINDOW_HEIGHT, 
+        SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
     renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
     TTF_Init();
     init();
 
-    // run
+    // run. only render when something has changed
     while (!update()) {
-        // render ~60 fps
-        static int last_tick = 0;
-        if (SDL_GetTicks() - last_tick >= 1000 / 60) {
+        if (dirty) {
             render();
-            last_tick = SDL_GetTicks();
+            dirty = false;
+            PROFILE_FRAME_END();
         }
-        SDL_Delay(1); // don't max out the CPU. don't need constant updates
     }
 
     // cleanup
+    stop_prefetch();
+    SDL_DestroySemaphore(prefetch_wake);
+    #ifdef PROFILE
+        if (PROFILE_SAVE("trace.json") == 0) {
+            printf("Saved profile to trace.json\n");
+        } else {
+            fprintf(stderr, "Failed to save trace.json\n");
+        }
+    #endif
+    SDL_DestroyTexture(atlas);
+    SDL_DestroyTexture(text.texture);
+    SDL_DestroyTexture(text_small.texture);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
+    if (list != NULL) unmap_id_list(list, list_count);
+    free_encoder(&encoder);
     TTF_Quit();
     IMG_Quit();
     SDL_Quit();
@@ -0,0 +1,149 @@
+/* commands.c - headless command line modes of artifactor
+    author: Andrew Klinge
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "commands.h"
+
+typedef struct Command {
+    const char *name;
+    int (*run)(int argc, char **argv);
+    const char *description;
+} Command;
+
+static const Command COMMANDS[] = {
+    {"export", export_main, "save artifacts to image files or sprite sheets"},
+    {"mine", mine_main, "search ranges of ids for interesting artifacts"},
+    {"dedup", dedup_main, "index which ids generate the same shapes"},
+    {"serve", serve_main, "serve artifact images over HTTP on localhost"},
+    {"lookup", lookup_main, "find the ids that generate an image"},
+    {"verify", verify_main, "check every generator backend against the "
+        "reference"},
+};
+
+int run_command(int argc, char **argv) {
+    const int n = sizeof(COMMANDS) / sizeof(COMMANDS[0]);
+    for (int i = 0; i < n; i++) {
+        if (strcmp(argv[0], COMMANDS[i].name) == 0) {
+            return COMMANDS[i].run(argc, argv);
+        }
+    }
+    fprintf(stderr, "Unknown command '%s'. Run without a command to browse "
+        "artifacts, or use one of:\n", argv[0]);
+    for (int i = 0; i < n; i++) {
+        fprintf(stderr, "  %-8s %s\n", COMMANDS[i].name, 
+            COMMANDS[i].description);
+    }
+    return EXIT_FAILURE;
+}
+
+bool parse_id(const char *str, uint32_t *id) {
+    char *end;
+    errno = 0;
+    unsigned long long value = strtoull(str, &end, 10);
+    if (errno || end == str || *end != '\0' || str[0] == '-' 
+    || value > UINT32_MAX) {
+        return false;
+    }
+    *id = (uint32_t) value;
+    return true;
+}
+
+bool parse_positive(const char *str, int *value) {
+    char *end;
+    errno = 0;
+    long parsed = strtol(str, &end, 10);
+    if (errno || end == str || *end != '\0' || parsed <= 0 
+    || parsed > INT_MAX) {
+        return false;
+    }
+    *value = (int) parsed;
+    return true;
+}
+
+uint32_t *read_id_list(const char *path, uint64_t *count) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+    uint64_t size = 0;
+    uint64_t capacity = 1024;
+    uint32_t *ids = malloc(sizeof(uint32_t) * capacity);
+    char line[64];
+    for (uint64_t n = 1; ids != NULL && fgets(line, sizeof(line), file); 
+    n++) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0') continue;
+        if (size == capacity) {
+            capacity *= 2;
+            uint32_t *grown = realloc(ids, sizeof(uint32_t) * capacity);
+            if (grown == NULL) {
+                free(ids);
+                ids = NULL;
+                break;
+            }
+            ids = grown;
+        }
+        if (!parse_id(line, &ids[size])) {
+            fprintf(stderr, "%s:%llu: invalid id '%s'\n", path, 
+                (unsigned long long) n, line);
+            free(ids);
+            fclose(file);
+            return NULL;
+        }
+        size++;
+    }
+    fclose(file);
+    if (ids == NULL) {
+        fprintf(stderr, "Failed to allocate %llu ids\n", 
+            (unsigned long long) capacity);
+        return NULL;
+    }
+    *count = size;
+    return ids;
+}
+
+const uint32_t *map_id_list(const char *path, uint64_t *count) {
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+        if (fd >= 0) close(fd);
+        return NULL;
+    }
+    if (st.st_size == 0 || st.st_size % sizeof(uint32_t) != 0) {
+        fprintf(stderr, "%s is not a binary id list\n", path);
+        close(fd);
+        return NULL;
+    }
+    // pages are only read in once something looks at them
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "Failed to map %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+    *count = st.st_size / sizeof(uint32_t);
+    return data;
+}
+
+void unmap_id_list(const uint32_t *ids, uint64_t count) {
+    munmap((void *) ids, sizeof(uint32_t) * count);
+}
+
+double seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
@@ -0,0 +1,59 @@
+/* commands.c - headless command line modes of artifactor
+    author: Andrew Klinge
+*/
+
+#ifndef _COMMANDS_H_
+#define _COMMANDS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Runs the command named by argv[0] with its arguments. Returns the exit
+ * status for the program. Prints the available commands if there is none
+ * with that name.
+ */
+int run_command(int argc, char **argv);
+
+/* parses an artifact id (0 to 2^32 - 1). returns false if invalid. */
+bool parse_id(const char *str, uint32_t *id);
+
+/* parses a positive int. returns false if invalid. */
+bool parse_positive(const char *str, int *value);
+
+/* Reads a text file of artifact ids, one per line. Returns the ids (to be
+ * freed by the caller) and sets count, or returns NULL after printing an 
+ * error.
+ */
+uint32_t *read_id_list(const char *path, uint64_t *count);
+
+/* Maps a binary file of artifact ids (uint32, native byte order, sorted 
+ * ascending) into memory, without reading it. Returns the ids (to be 
+ * unmapped with unmap_id_list()) and sets count, or returns NULL after 
+ * printing an error.
+ */
+const uint32_t *map_id_list(const char *path, uint64_t *count);
+
+void unmap_id_list(const uint32_t *ids, uint64_t count);
+
+/* returns monotonic time in seconds, for measuring throughput. */
+double seconds(void);
+
+/* artifactor export - see export.c */
+int export_main(int argc, char **argv);
+
+/* artifactor mine - see mine.c */
+int mine_main(int argc, char **argv);
+
+/* artifactor dedup - see dedup.c */
+int dedup_main(int argc, char **argv);
+
+/* artifactor serve - see server.c */
+int serve_main(int argc, char **argv);
+
+/* artifactor lookup - see lookup.c */
+int lookup_main(int argc, char **argv);
+
+/* artifactor verify - see verify.c */
+int verify_main(int argc, char **argv);
+
+#endif
@@ -0,0 +1,510 @@
+/* dedup.c - indexes which ids generate the same shapes
+    author: Andrew Klinge
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "commands.h"
+#include "generator.h"
+#include "parallel.h"
+
+// index flags: what counts as the same shape
+#define DEDUP_PATTERN 1 // also compare how pixels split into the two colors
+#define DEDUP_ORIENT 2 // ignore rotation and mirroring
+#define DEDUP_V2 4 // artifacts of generator v2 (else v1)
+
+#define DEDUP_MAGIC "ARTDEDUP"
+#define DEDUP_VERSION 1
+// artifacts generated at once by a worker
+#define DEDUP_BATCH 256
+// most (key, id) records buffered per shard by each worker
+#define SHARD_BUFFER 4096
+// fewest, so writes to the shards don't get too small
+#define MIN_SHARD_BUFFER 16
+// bytes of all workers' shard buffers together, fewer records are buffered
+// per shard so that more threads and shards still fit
+#define SHARD_BUFFER_BYTES (64 << 20)
+// bytes of a record in a shard file
+#define RECORD_SIZE 12
+
+static const char *USAGE =
+    "usage: artifactor dedup build [options] INDEX FIRST LAST\n"
+    "       artifactor dedup count INDEX\n"
+    "       artifactor dedup query INDEX ID\n"
+    "build: indexes artifacts FIRST to LAST by shape into the file INDEX.\n"
+    "  -p           also tell apart how pixels split into the two colors\n"
+    "               (but not which colors they are)\n"
+    "  -r           treat rotated/mirrored shapes as the same\n"
+    "  -v VERSION   generator: v1 (default) or v2\n"
+    "  -s SHARDS    temporary shard files, a power of 2 (default: 256).\n"
+    "               each shard is sorted in memory on its own\n"
+    "  -j THREADS   worker threads (default: number of cores)\n"
+    "count: prints the number of distinct shapes in the index.\n"
+    "query: prints all indexed ids with the same shape as ID.\n";
+
+/* Index file layout (native byte order), all sections 8-byte aligned:
+ * header, ids (uint32, grouped by key, ascending within a group), keys 
+ * (uint64, ascending) and offsets (uint64, key_count + 1 entries; the ids
+ * of keys[i] are ids[offsets[i]] to ids[offsets[i + 1] - 1]).
+ */
+typedef struct IndexHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint64_t id_count;
+    uint64_t key_count;
+    uint64_t ids_offset;
+    uint64_t keys_offset;
+    uint64_t offsets_offset;
+} IndexHeader;
+
+typedef struct Entry {
+    uint64_t key;
+    uint32_t id;
+} Entry;
+
+typedef struct Build {
+    uint32_t first;
+    uint64_t count;
+    int flags;
+    int shard_bits;
+    int shards;
+    const char *index;
+    FILE **files; // shard files
+    pthread_mutex_t *locks; // one per shard file
+    uint8_t **buffers; // [worker * shards + shard], buffer_records each
+    int buffer_records;
+    int *buffered; // records in each buffer
+} Build;
+
+/* mixes bits (bijective), so keys are evenly spread over the shards. */
+static uint64_t mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
+/* finds the canonical form of the artifact's shape: its mask, or with 
+ * DEDUP_PATTERN its two color groups (lo, hi), in the orientation where 
+ * they are smallest.
+ */
+static void canonical_shape(const PackedArtifact *artifact, int flags, 
+        uint64_t *best_lo, uint64_t *best_hi) {
+    *best_lo = UINT64_MAX;
+    *best_hi = UINT64_MAX;
+    int orientations = (flags & DEDUP_ORIENT) ? ARTIFACT_ORIENTATIONS : 1;
+    for (int i = 0; i < orientations; i++) {
+        uint64_t lo = orient_bits(artifact->mask, i);
+        uint64_t hi = 0;
+        if (flags & DEDUP_PATTERN) {
+            // the two color groups, in either order
+            uint64_t a = orient_bits(artifact->mask & artifact->select, i);
+            uint64_t b = orient_bits(artifact->mask & ~artifact->select, i);
+            lo = a < b ? a : b;
+            hi = a < b ? b : a;
+        }
+        if (lo < *best_lo || (lo == *best_lo && hi < *best_hi)) {
+            *best_lo = lo;
+            *best_hi = hi;
+        }
+    }
+}
+
+/* returns the key of a canonical shape. shapes are only told apart by
+ * their mask, so the key is exact; patterns are hashed down to 64 bits, so
+ * different patterns can (rarely) share a key.
+ */
+static uint64_t canonical_key(uint64_t lo, uint64_t hi, int flags) {
+    if (flags & DEDUP_PATTERN) return mix(lo ^ mix(hi));
+    return mix(lo);
+}
+
+/* returns the key of the artifact's shape. */
+static uint64_t shape_key(const PackedArtifact *artifact, int flags) {
+    uint64_t lo, hi;
+    canonical_shape(artifact, flags, &lo, &hi);
+    return canonical_key(lo, hi, flags);
+}
+
+/* returns the ARTIFACT_V* version of the generator of an index. */
+static int flags_version(int flags) {
+    return (flags & DEDUP_V2) ? ARTIFACT_V2 : ARTIFACT_V1;
+}
+
+/* finds the canonical shape of the artifact with the given id. */
+static void id_shape(uint32_t id, int flags, uint64_t *lo, uint64_t *hi) {
+    PackedArtifact artifact;
+    generate_artifact_packed(&artifact, id, flags_version(flags));
+    canonical_shape(&artifact, flags, lo, hi);
+}
+
+/* writes out a worker's buffered records of a shard. */
+static void flush_shard(Build *build, int worker, int shard) {
+    int index = worker * build->shards + shard;
+    if (build->buffered[index] == 0) return;
+    pthread_mutex_lock(&build->locks[shard]);
+    size_t written = fwrite(build->buffers[index], RECORD_SIZE, 
+        build->buffered[index], build->files[shard]);
+    pthread_mutex_unlock(&build->locks[shard]);
+    if (written != build->buffered[index]) {
+        fprintf(stderr, "Failed to write shard: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    build->buffered[index] = 0;
+}
+
+/* sorts the (key, id) records of ids [start, start + count) into shards. */
+static void shard_ids(void *ctx, uint64_t start, uint64_t count, int worker) {
+    Build *build = ctx;
+    PackedArtifact artifacts[DEDUP_BATCH];
+    for (uint64_t i = 0; i < count; i += DEDUP_BATCH) {
+        int n = count - i < DEDUP_BATCH ? count - i : DEDUP_BATCH;
+        uint32_t id = build->first + start + i;
+        generate_artifacts_packed(artifacts, id, n, 
+            flags_version(build->flags));
+        for (int j = 0; j < n; j++) {
+            uint64_t key = shape_key(&artifacts[j], build->flags);
+            uint32_t record_id = id + j;
+            int shard = build->shard_bits ? key >> (64 - build->shard_bits) 
+                : 0;
+            int index = worker * build->shards + shard;
+            uint8_t *record = build->buffers[index] 
+                + build->buffered[index] * RECORD_SIZE;
+            memcpy(record, &key, sizeof(key));
+            memcpy(record + sizeof(key), &record_id, sizeof(record_id));
+            if (++build->buffered[index] == build->buffer_records) {
+                flush_shard(build, worker, shard);
+            }
+        }
+    }
+}
+
+static int compare_entries(const void *a, const void *b) {
+    const Entry *x = a;
+    const Entry *y = b;
+    if (x->key != y->key) return x->key < y->key ? -1 : 1;
+    return (x->id > y->id) - (x->id < y->id);
+}
+
+/* copies the rest of src to the end of dest. returns false on failure. */
+static bool append_file(FILE *dest, FILE *src) {
+    char buffer[1 << 16];
+    size_t n;
+    rewind(src);
+    while ((n = fread(buffer, 1, sizeof(buffer), src)) > 0) {
+        if (fwrite(buffer, 1, n, dest) != n) return false;
+    }
+    return !ferror(src);
+}
+
+static int build_index(Build *build, int threads) {
+    if (threads <= 0) threads = parallel_threads();
+    char path[PATH_MAX];
+
+    // pass 1: generate everything, spreading (key, id) records over shards
+    double start = seconds();
+    build->files = malloc(sizeof(FILE *) * build->shards);
+    build->locks = malloc(sizeof(pthread_mutex_t) * build->shards);
+    if (build->files == NULL || build->locks == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return EXIT_FAILURE;
+    }
+    for (int i = 0; i < build->shards; i++) {
+        snprintf(path, sizeof(path), "%s.shard%d", build->index, i);
+        build->files[i] = fopen(path, "w+b");
+        if (build->files[i] == NULL) {
+            fprintf(stderr, "Failed to create %s: %s\n", path, 
+                strerror(errno));
+            return EXIT_FAILURE;
+        }
+        remove(path); // only needed while open
+        pthread_mutex_init(&build->locks[i], NULL);
+    }
+    uint64_t records = SHARD_BUFFER_BYTES 
+        / ((uint64_t) threads * build->shards * RECORD_SIZE);
+    if (records > SHARD_BUFFER) records = SHARD_BUFFER;
+    if (records < MIN_SHARD_BUFFER) records = MIN_SHARD_BUFFER;
+    build->buffer_records = records;
+    build->buffers = malloc(sizeof(uint8_t *) * threads * build->shards);
+    build->buffered = calloc(threads * build->shards, sizeof(int));
+    if (build->buffers == NULL || build->buffered == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return EXIT_FAILURE;
+    }
+    for (int i = 0; i < threads * build->shards; i++) {
+        build->buffers[i] = malloc(RECORD_SIZE * build->buffer_records);
+        if (build->buffers[i] == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            return EXIT_FAILURE;
+        }
+    }
+    parallel_for(build->count, DEDUP_BATCH * 64, threads, shard_ids, build);
+    for (int worker = 0; worker < threads; worker++) {
+        for (int shard = 0; shard < build->shards; shard++) {
+            flush_shard(build, worker, shard);
+        }
+    }
+    for (int i = 0; i < threads * build->shards; i++) {
+        free(build->buffers[i]);
+    }
+    free(build->buffers);
+    free(build->buffered);
+    fprintf(stderr, "Generated %llu artifacts in %.2f s (%.0f/s)\n",
+        (unsigned long long) build->count, seconds() - start, 
+        build->count / (seconds() - start));
+
+    // pass 2: sort the shards one at a time. their keys don't overlap, so
+    // writing them in order keeps the index sorted
+    FILE *output = fopen(build->index, "wb");
+    FILE *keys = tmpfile();
+    FILE *offsets = tmpfile();
+    if (output == NULL || keys == NULL || offsets == NULL) {
+        fprintf(stderr, "Failed to create %s: %s\n", build->index, 
+            strerror(errno));
+        return EXIT_FAILURE;
+    }
+    IndexHeader header = {.magic = DEDUP_MAGIC, .version = DEDUP_VERSION,
+        .flags = build->flags, .id_count = build->count, 
+        .ids_offset = sizeof(IndexHeader)};
+    fwrite(&header, sizeof(header), 1, output);
+    uint64_t written = 0; // ids written
+    bool ok = true;
+    for (int i = 0; i < build->shards && ok; i++) {
+        FILE *file = build->files[i];
+        uint64_t size = ftell(file) / RECORD_SIZE;
+        uint8_t *records = malloc(size * RECORD_SIZE + 1);
+        Entry *entries = malloc(sizeof(Entry) * size + 1);
+        rewind(file);
+        if (records == NULL || entries == NULL 
+        || fread(records, RECORD_SIZE, size, file) != size) {
+            fprintf(stderr, "Failed to read shard %d\n", i);
+            return EXIT_FAILURE;
+        }
+        fclose(file);
+        for (uint64_t j = 0; j < size; j++) {
+            memcpy(&entries[j].key, records + j * RECORD_SIZE, 
+                sizeof(uint64_t));
+            memcpy(&entries[j].id, records + j * RECORD_SIZE 
+                + sizeof(uint64_t), sizeof(uint32_t));
+        }
+        free(records);
+        qsort(entries, size, sizeof(Entry), compare_entries);
+
+        for (uint64_t j = 0; j < size; j++) {
+            if (j == 0 || entries[j].key != entries[j - 1].key) {
+                uint64_t offset = written + j;
+                ok &= fwrite(&entries[j].key, sizeof(uint64_t), 1, keys) == 1;
+                ok &= fwrite(&offset, sizeof(uint64_t), 1, offsets) == 1;
+                header.key_count++;
+            }
+            ok &= fwrite(&entries[j].id, sizeof(uint32_t), 1, output) == 1;
+        }
+        written += size;
+        free(entries);
+    }
+    ok &= fwrite(&written, sizeof(uint64_t), 1, offsets) == 1;
+
+    // append keys and offsets after the (padded) ids, then fill in header
+    uint64_t padding = 0;
+    uint64_t end = sizeof(IndexHeader) + written * sizeof(uint32_t);
+    ok &= fwrite(&padding, 1, (8 - end % 8) % 8, output) == (8 - end % 8) % 8;
+    header.keys_offset = (end + 7) / 8 * 8;
+    header.offsets_offset = header.keys_offset 
+        + header.key_count * sizeof(uint64_t);
+    ok &= append_file(output, keys) && append_file(output, offsets);
+    rewind(output);
+    ok &= fwrite(&header, sizeof(header), 1, output) == 1;
+    ok &= fclose(output) == 0;
+    fclose(keys);
+    fclose(offsets);
+    free(build->files);
+    free(build->locks);
+    if (!ok) {
+        fprintf(stderr, "Failed to write %s\n", build->index);
+        return EXIT_FAILURE;
+    }
+    fprintf(stderr, "Indexed %llu distinct shapes in %.2f s\n", 
+        (unsigned long long) header.key_count, seconds() - start);
+    return EXIT_SUCCESS;
+}
+
+/* a memory-mapped index. */
+typedef struct Index {
+    const IndexHeader *header;
+    const uint32_t *ids;
+    const uint64_t *keys;
+    const uint64_t *offsets;
+    size_t size;
+} Index;
+
+/* returns whether count elements of elem_size bytes at offset are within 
+ * a file of the given size, 8-byte aligned.
+ */
+static bool section_fits(uint64_t offset, uint64_t count, size_t elem_size,
+        size_t size) {
+    return offset % 8 == 0 && offset <= size 
+        && count <= (size - offset) / elem_size;
+}
+
+/* maps the index file into memory. returns false after printing an error. */
+static bool open_index(const char *path, Index *index) {
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+        if (fd >= 0) close(fd);
+        return false;
+    }
+    index->size = st.st_size;
+    void *data = index->size >= sizeof(IndexHeader) ? mmap(NULL, index->size,
+        PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    const IndexHeader *header = data;
+    if (data == MAP_FAILED || memcmp(header->magic, DEDUP_MAGIC, 8) != 0 
+    || header->version != DEDUP_VERSION 
+    || !section_fits(header->ids_offset, header->id_count, sizeof(uint32_t), 
+        index->size)
+    || !section_fits(header->keys_offset, header->key_count, 
+        sizeof(uint64_t), index->size)
+    || header->key_count == UINT64_MAX
+    || !section_fits(header->offsets_offset, header->key_count + 1, 
+        sizeof(uint64_t), index->size)) {
+        fprintf(stderr, "%s is not a dedup index\n", path);
+        if (data != MAP_FAILED) munmap(data, index->size);
+        return false;
+    }
+    index->header = header;
+    index->ids = (const uint32_t *) ((const char *) data + header->ids_offset);
+    index->keys = (const uint64_t *) ((const char *) data 
+        + header->keys_offset);
+    index->offsets = (const uint64_t *) ((const char *) data 
+        + header->offsets_offset);
+    return true;
+}
+
+static void close_index(Index *index) {
+    munmap((void *) index->header, index->size);
+}
+
+static int count_shapes(const char *path) {
+    Index index;
+    if (!open_index(path, &index)) return EXIT_FAILURE;
+    uint64_t singles = 0;
+    uint64_t largest = 0;
+    for (uint64_t i = 0; i < index.header->key_count; i++) {
+        uint64_t size = index.offsets[i + 1] - index.offsets[i];
+        if (size == 1) singles++;
+        if (size > largest) largest = size;
+    }
+    printf("%llu distinct shapes in %llu ids (%llu unique to one id, "
+        "largest shared by %llu ids)\n", 
+        (unsigned long long) index.header->key_count,
+        (unsigned long long) index.header->id_count,
+        (unsigned long long) singles, (unsigned long long) largest);
+    close_index(&index);
+    return EXIT_SUCCESS;
+}
+
+static int query_shape(const char *path, uint32_t id) {
+    Index index;
+    if (!open_index(path, &index)) return EXIT_FAILURE;
+    const int flags = index.header->flags;
+    uint64_t shape_lo, shape_hi;
+    id_shape(id, flags, &shape_lo, &shape_hi);
+    uint64_t key = canonical_key(shape_lo, shape_hi, flags);
+    // binary search for the key
+    uint64_t lo = 0;
+    uint64_t hi = index.header->key_count;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (index.keys[mid] < key) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo < index.header->key_count && index.keys[lo] == key) {
+        if (index.offsets[lo] > index.offsets[lo + 1] 
+        || index.offsets[lo + 1] > index.header->id_count) {
+            fprintf(stderr, "%s is corrupt\n", path);
+            close_index(&index);
+            return EXIT_FAILURE;
+        }
+        for (uint64_t i = index.offsets[lo]; i < index.offsets[lo + 1]; i++) {
+            // hashed patterns can collide, so check them against the shape
+            if (flags & DEDUP_PATTERN) {
+                uint64_t other_lo, other_hi;
+                id_shape(index.ids[i], flags, &other_lo, &other_hi);
+                if (other_lo != shape_lo || other_hi != shape_hi) continue;
+            }
+            printf("%u\n", index.ids[i]);
+        }
+    }
+    close_index(&index);
+    return EXIT_SUCCESS;
+}
+
+int dedup_main(int argc, char **argv) {
+    if (argc < 2) {
+        fputs(USAGE, stderr);
+        return EXIT_FAILURE;
+    }
+    const char *mode = argv[1];
+    uint32_t id;
+    if (strcmp(mode, "count") == 0 && argc == 3) {
+        return count_shapes(argv[2]);
+    } else if (strcmp(mode, "query") == 0 && argc == 4 
+    && parse_id(argv[3], &id)) {
+        return query_shape(argv[2], id);
+    } else if (strcmp(mode, "build") != 0) {
+        fputs(USAGE, stderr);
+        return EXIT_FAILURE;
+    }
+
+    Build build = {.shards = 256};
+    int threads = 0;
+    int opt;
+    optind = 2;
+    while ((opt = getopt(argc, argv, "prs:j:v:")) != -1) {
+        bool valid = true;
+        switch (opt) {
+            case 'p': build.flags |= DEDUP_PATTERN; break;
+            case 'r': build.flags |= DEDUP_ORIENT; break;
+            case 's': 
+                valid = parse_positive(optarg, &build.shards) 
+                    && (build.shards & (build.shards - 1)) == 0;
+                break;
+            case 'j': valid = parse_positive(optarg, &threads); break;
+            case 'v': {
+                int version = artifact_version_by_name(optarg);
+                valid = version >= 0;
+                if (version == ARTIFACT_V2) build.flags |= DEDUP_V2;
+                break;
+            }
+            default: valid = false; break;
+        }
+        if (!valid) {
+            fputs(USAGE, stderr);
+            return EXIT_FAILURE;
+        }
+    }
+    uint32_t last;
+    if (optind + 3 != argc || !parse_id(argv[optind + 1], &build.first) 
+    || !parse_id(argv[optind + 2], &last) || last < build.first) {
+        fputs(USAGE, stderr);
+        return EXIT_FAILURE;
+    }
+    build.index = argv[optind];
+    build.count = (uint64_t) last - build.first + 1;
+    while ((1 << build.shard_bits) < build.shards) build.shard_bits++;
+    return build_index(&build, threads);
+}
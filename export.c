@@ -0,0 +1,285 @@
+/* export.c - saves artifacts to image files without opening a window
+    author: Andrew Klinge
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "commands.h"
+#include "generator.h"
+#include "image.h"
+#include "parallel.h"
+
+// artifacts generated at once by a worker
+#define EXPORT_BATCH 256
+// max width or height of a sprite sheet in pixels, after scaling
+#define MAX_SHEET_SIDE (1 << 16)
+
+static const char *USAGE =
+    "usage: artifactor export [options] FIRST LAST\n"
+    "       artifactor export [options] -l FILE\n"
+    "Saves artifacts FIRST to LAST (inclusive), or the ids listed in FILE\n"
+    "(one per line), as <id>.png or as sprite sheets sheet_<n>.png.\n"
+    "  -o DIR       output directory (default: .)\n"
+    "  -t TYPE      image type: png, gif or bmp (default: png)\n"
+    "  -s SCALE     scale factor of saved images (default: 1)\n"
+    "  -z SIZE      size of the artifacts: 8, 16 or 32 (default: 8)\n"
+    "  -y SYMMETRY  symmetry of every artifact instead of the drawn one:\n"
+    "               d4, rot4 or point (default: drawn)\n"
+    "  -v VERSION   generator: v1 (default) or v2\n"
+    "  -g COLSxROWS tile artifacts into sprite sheets of this many\n"
+    "  -j THREADS   worker threads (default: number of cores)\n";
+
+typedef struct Export {
+    uint32_t first; // first id, if there is no id list
+    uint32_t *ids; // ids to export, or NULL for the range from first
+    uint64_t count; // number of artifacts
+    const char *dir;
+    int scale;
+    ArtifactFormat format; // of the artifacts, before scaling
+    int sheet_cols, sheet_rows; // 0 for one file per artifact
+    int type; // IMAGE_* format of the files
+    Encoder *encoders; // one per worker
+    atomic_bool failed;
+} Export;
+
+/* generates artifacts [start, start + count) of the export into pixels, one
+ * after another.
+ */
+static void generate(Export *export, uint64_t start, int count, 
+        uint32_t *pixels) {
+    const int area = export->format.size * export->format.size;
+    if (export->ids == NULL) {
+        generate_artifacts_rgba(pixels, export->first + start, count, 
+            &export->format, IMAGE_ALPHA);
+        return;
+    }
+    const uint32_t *ids = export->ids + start;
+    int i = 0;
+    while (i < count) {
+        // consecutive ids are generated together
+        int n = 1;
+        while (i + n < count && ids[i + n] == ids[i] + n) n++;
+        if (n > 1) {
+            generate_artifacts_rgba(pixels + i * area, ids[i], n, 
+                &export->format, IMAGE_ALPHA);
+        } else {
+            // a batch of one would still run every lane, so go scalar
+            int *artifact = (int *) pixels + i * area;
+            generate_artifact_format(artifact, ids[i], &export->format);
+            // like expand_artifact_rgba(), in place
+            for (int j = 0; j < area; j++) {
+                pixels[i * area + j] = artifact[j] 
+                    ? (artifact[j] | IMAGE_ALPHA) : 0;
+            }
+        }
+        i += n;
+    }
+}
+
+/* allocates pixels for a batch of artifacts of the export. */
+static uint32_t *create_batch(Export *export) {
+    const int size = export->format.size;
+    uint32_t *pixels = malloc(sizeof(uint32_t) * EXPORT_BATCH * size * size);
+    if (pixels == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    return pixels;
+}
+
+/* saves the image scaled up, reporting the first failure. */
+static void save(Export *export, const Image *image, const char *path, 
+        int worker) {
+    Encoder *encoder = &export->encoders[worker];
+    if (encode_image(encoder, image, export->scale, export->type) != 0) {
+        // encoding doesn't reliably set errno, so leave it out
+        if (!atomic_exchange(&export->failed, 1)) {
+            fprintf(stderr, "Failed to encode %s\n", path);
+        }
+    } else if (save_encoded(encoder, path) != 0) {
+        if (!atomic_exchange(&export->failed, 1)) {
+            fprintf(stderr, "Failed to save %s: %s\n", path, 
+                strerror(errno));
+        }
+    }
+}
+
+/* saves artifacts [start, start + count) to one file each. */
+static void export_files(void *ctx, uint64_t start, uint64_t count, 
+        int worker) {
+    Export *export = ctx;
+    const int size = export->format.size;
+    uint32_t *pixels = create_batch(export);
+    char path[PATH_MAX];
+
+    for (uint64_t i = 0; i < count && !export->failed; i += EXPORT_BATCH) {
+        int n = count - i < EXPORT_BATCH ? count - i : EXPORT_BATCH;
+        generate(export, start + i, n, pixels);
+        for (int j = 0; j < n; j++) {
+            uint32_t id = export->ids ? export->ids[start + i + j] 
+                : export->first + start + i + j;
+            // the generated pixels are already an image, scaled as it's saved
+            Image image = {.width = size, .height = size, 
+                .pixels = pixels + j * size * size};
+            snprintf(path, sizeof(path), "%s/%u.%s", export->dir, id, 
+                image_format_name(export->type));
+            save(export, &image, path, worker);
+        }
+    }
+    free(pixels);
+}
+
+/* saves sprite sheets [start, start + count). */
+static void export_sheets(void *ctx, uint64_t start, uint64_t count,
+        int worker) {
+    Export *export = ctx;
+    const int size = export->format.size;
+    const uint64_t per_sheet = (uint64_t) export->sheet_cols 
+        * export->sheet_rows;
+    uint32_t *pixels = create_batch(export);
+    Image image = create_image(size * export->sheet_cols, 
+        size * export->sheet_rows);
+    char path[PATH_MAX];
+
+    for (uint64_t sheet = start; sheet < start + count; sheet++) {
+        if (export->failed) break;
+        uint64_t first = sheet * per_sheet;
+        uint64_t tiles = export->count - first;
+        if (tiles > per_sheet) tiles = per_sheet;
+
+        memset(image.pixels, 0, sizeof(uint32_t) * image.width * image.height);
+        for (int i = 0; i < tiles; i += EXPORT_BATCH) {
+            int n = tiles - i < EXPORT_BATCH ? tiles - i : EXPORT_BATCH;
+            generate(export, first + i, n, pixels);
+            for (int j = 0; j < n; j++) {
+                int tile = i + j;
+                draw_pixels(&image, pixels + j * size * size, size,
+                    (tile % export->sheet_cols) * size, 
+                    (tile / export->sheet_cols) * size, 1);
+            }
+        }
+        snprintf(path, sizeof(path), "%s/sheet_%llu.%s", export->dir, 
+            (unsigned long long) sheet, image_format_name(export->type));
+        save(export, &image, path, worker);
+    }
+    free(pixels);
+    free_image(&image);
+}
+
+int export_main(int argc, char **argv) {
+    Export export = {.dir = ".", .scale = 1, 
+        .format = ARTIFACT_DEFAULT_FORMAT, .type = IMAGE_PNG};
+    atomic_init(&export.failed, 0);
+    const char *list = NULL;
+    int threads = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "o:t:s:z:y:v:g:j:l:")) != -1) {
+        bool valid = true;
+        switch (opt) {
+            case 'o': export.dir = optarg; break;
+            case 't': 
+                export.type = image_format_by_name(optarg);
+                valid = export.type >= 0;
+                break;
+            case 's': valid = parse_positive(optarg, &export.scale); break;
+            case 'z': 
+                valid = parse_positive(optarg, &export.format.size) 
+                    && artifact_size_supported(export.format.size);
+                break;
+            case 'y': 
+                export.format.symmetry = artifact_symmetry_by_name(optarg);
+                valid = export.format.symmetry >= 0;
+                break;
+            case 'v': 
+                export.format.version = artifact_version_by_name(optarg);
+                valid = export.format.version >= 0;
+                break;
+            case 'j': valid = parse_positive(optarg, &threads); break;
+            case 'l': list = optarg; break;
+            case 'g': 
+                valid = sscanf(optarg, "%dx%d", &export.sheet_cols, 
+                    &export.sheet_rows) == 2 && export.sheet_cols > 0 
+                    && export.sheet_rows > 0;
+                break;
+            default: valid = false; break;
+        }
+        if (!valid) {
+            fputs(USAGE, stderr);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // sheets are drawn whole, then scaled as they're encoded
+    if ((uint64_t) export.format.size * export.sheet_cols * export.scale 
+        > MAX_SHEET_SIDE
+    || (uint64_t) export.format.size * export.sheet_rows * export.scale 
+        > MAX_SHEET_SIDE) {
+        fprintf(stderr, "Sprite sheets can be at most %d pixels wide and "
+            "high\n", MAX_SHEET_SIDE);
+        return EXIT_FAILURE;
+    }
+
+    if (list != NULL && optind == argc) {
+        export.ids = read_id_list(list, &export.count);
+        if (export.ids == NULL) return EXIT_FAILURE;
+    } else {
+        uint32_t last;
+        if (list != NULL || optind + 2 != argc 
+        || !parse_id(argv[optind], &export.first) 
+        || !parse_id(argv[optind + 1], &last) || last < export.first) {
+            fputs(USAGE, stderr);
+            return EXIT_FAILURE;
+        }
+        export.count = (uint64_t) last - export.first + 1;
+    }
+
+    if (mkdir(export.dir, 0777) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Failed to create %s: %s\n", export.dir, 
+            strerror(errno));
+        free(export.ids);
+        return EXIT_FAILURE;
+    }
+
+    // a sheet holds 2 colors per artifact, and GIFs only 256 with transparent
+    if (export.type == IMAGE_GIF && export.sheet_cols > 0
+    && (uint64_t) export.sheet_cols * export.sheet_rows > 127) {
+        fprintf(stderr, "GIF sprite sheets can hold at most 127 artifacts\n");
+        free(export.ids);
+        return EXIT_FAILURE;
+    }
+
+    if (threads == 0) threads = parallel_threads();
+    export.encoders = calloc(threads, sizeof(Encoder));
+    if (export.encoders == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        free(export.ids);
+        return EXIT_FAILURE;
+    }
+    double start = seconds();
+    if (export.sheet_cols > 0) {
+        const uint64_t per_sheet = (uint64_t) export.sheet_cols 
+            * export.sheet_rows;
+        uint64_t sheets = (export.count + per_sheet - 1) / per_sheet;
+        parallel_for(sheets, 1, threads, export_sheets, &export);
+    } else {
+        parallel_for(export.count, EXPORT_BATCH * 4, threads, export_files, 
+            &export);
+    }
+    double elapsed = seconds() - start;
+
+    for (int i = 0; i < threads; i++) free_encoder(&export.encoders[i]);
+    free(export.encoders);
+    free(export.ids);
+    if (export.failed) return EXIT_FAILURE;
+    fprintf(stderr, "Exported %llu artifacts in %.2f s (%.0f/s)\n", 
+        (unsigned long long) export.count, elapsed, export.count / elapsed);
+    return EXIT_SUCCESS;
+}
@@ -1,16 +1,30 @@
-/* generator.c - generates two-color, symmetric, 8x8 artifacts
+/* generator.c - generates two-color, symmetric, 8x8 (or 16x16, 32x32) 
+ * artifacts
     author: Andrew Klinge
 */
 
-#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <pthread.h>
 
 #include "generator.h"
 
-const int GENERATED_SIZE = 8;
+// number of initial random numbers discarded after seeding
+#define RAND_DISCARD (ARTIFACT_RAND_DEG * 10)
+// max random numbers drawn for one artifact (fill, colors, symmetry)
+#define SIZED_DRAWS(size) ((size) * (size) * 2 + 4)
+#define MAX_DRAWS SIZED_DRAWS(8)
+
+// for the generic pixel code, which is only fast once the size is constant
+#ifdef __GNUC__
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define ALWAYS_INLINE inline
+#endif
 
 /* converts y-coordinate into index used in linear pixels array. */
-static inline int Y(int y) {
-    return GENERATED_SIZE * y;
+static ALWAYS_INLINE int Y(int y, int size) {
+    return size * y;
 }
 
 /* will rotate and or reflect the image based on arguments.
@@ -21,105 +35,1003 @@ static inline int Y(int y) {
  * xt - x offset for dest pixels of copied area. (>= 0, reflects if != 0) 
  * yt - y offset for dest pixels of copied area (>= 0, reflects if != 0)
  */
-static void transform(int *pixels, int wdiv, int hdiv, int xt, int yt) {
-    for (int x = 0; x < GENERATED_SIZE / wdiv; x++) {
-        for (int y = 0; y < GENERATED_SIZE / hdiv; y++) {
+static ALWAYS_INLINE void transform(int *pixels, int size, int wdiv, int hdiv, 
+        int xt, int yt) {
+    for (int x = 0; x < size / wdiv; x++) {
+        for (int y = 0; y < size / hdiv; y++) {
             int rx = (xt == 0 ? x : xt - x);
             int ry = (yt == 0 ? y : yt - y);
-            pixels[rx + Y(ry)] = pixels[x + Y(y)];
+            pixels[rx + Y(ry, size)] = pixels[x + Y(y, size)];
         }
     }
 }
 
 /* rotates the point 90 degrees clockwise. */
-static void rotate90(int *x, int *y) {
-    int nx = GENERATED_SIZE - 1 - (*y);
+static ALWAYS_INLINE void rotate90(int *x, int *y, int size) {
+    int nx = size - 1 - (*y);
     int ny = (*x);
     *x = nx;
     *y = ny;
 }
 
-void generate_artifact(int *pixels, int id) {
-    srand(id);
-
-    // randomly fill in pixels (0->transparent, 1->placeholder pixel)
-    for (int x = 0; x < GENERATED_SIZE; x++) {
-        for (int y = 0; y < GENERATED_SIZE; y++) {
-            if ((rand() & 3) <= 1) pixels[x + Y(y)] = 1;
-            else pixels[x + Y(y)] = 0;
-        }
+/* fills in the initial state words for the given seed, the same way glibc's
+ * srand() sets up its additive feedback generator (TYPE_3).
+ */
+static void seed_state(uint32_t *state, uint32_t seed) {
+    if (seed == 0) seed = 1;
+    int32_t word = (int32_t) seed;
+    state[0] = word;
+    for (int i = 1; i < ARTIFACT_RAND_DEG; i++) {
+        // word = (16807 * word) % 2147483647 without overflowing
+        int32_t hi = word / 127773;
+        int32_t lo = word % 127773;
+        word = 16807 * lo - 2836 * hi;
+        if (word < 0) word += 2147483647;
+        state[i] = word;
     }
+}
 
-    // randomly assign two colors
-    int col1 = rand();
-    int col2 = rand();
-    for (int x = 0; x < GENERATED_SIZE; x++) {
-        for (int y = 0; y < GENERATED_SIZE; y++) {
-            if (pixels[x + Y(y)] != 0) {
-                if (rand() & 1) pixels[x + Y(y)] = col1;
-                else pixels[x + Y(y)] = col2; 
-            }
-        }
-    }
-    
-    // determine symmetry (rotate or reflect some quadrant(s) of sprite)
-    int sym_type = (rand() & 3);
-    int rot_vs_ref = (rand() & 1); 
-    const int reflect = GENERATED_SIZE - 1;
+/* applies the given symmetry by copying some quadrant(s) of the sprite onto
+ * the rest of it.
+ *
+ * size - width and height of pixels
+ * sym_type - 0: vertical, 1: horizontal, 2: quadrant, 3: diagonal
+ * rot_vs_ref - whether to rotate (1) or reflect (0) the copied area
+ */
+static ALWAYS_INLINE void symmetrize(int *pixels, int size, int sym_type, 
+        int rot_vs_ref) {
+    const int reflect = size - 1;
     switch (sym_type) {
         case 0: // vertical symmetry ||
             if (rot_vs_ref) { // rotate
-                transform(pixels, 2, 1, reflect, reflect);
+                transform(pixels, size, 2, 1, reflect, reflect);
             } else { // reflect
-                transform(pixels, 2, 1, reflect, 0);
+                transform(pixels, size, 2, 1, reflect, 0);
             }
             break;
         case 1: // horizontal symmetry =
             if (rot_vs_ref) { // rotate
-                transform(pixels, 1, 2, reflect, reflect);
+                transform(pixels, size, 1, 2, reflect, reflect);
             } else { // reflect
-                transform(pixels, 1, 2, 0, reflect);
+                transform(pixels, size, 1, 2, 0, reflect);
             }
             break;
         case 2: // quadrant symmetry ::
             if (rot_vs_ref) { // rotate
-                const int half = GENERATED_SIZE / 2;
+                const int half = size / 2;
                 for (int x = 0; x < half; x++) {
                     for (int y = 0; y < half; y++) {
-                        int p = pixels[x + Y(y)];
+                        int p = pixels[x + Y(y, size)];
                         int rx = x;
                         int ry = y;
 
-                        rotate90(&rx, &ry);
-                        pixels[rx + Y(ry)] = p;
+                        rotate90(&rx, &ry, size);
+                        pixels[rx + Y(ry, size)] = p;
 
-                        rotate90(&rx, &ry);
-                        pixels[rx + Y(ry)] = p;
+                        rotate90(&rx, &ry, size);
+                        pixels[rx + Y(ry, size)] = p;
 
-                        rotate90(&rx, &ry);
-                        pixels[rx + Y(ry)] = p;
+                        rotate90(&rx, &ry, size);
+                        pixels[rx + Y(ry, size)] = p;
                     }
                 }
             } else { // reflect
-                transform(pixels, 2, 2, reflect, reflect);
-                transform(pixels, 2, 2, 0, reflect);
-                transform(pixels, 2, 2, reflect, 0);
+                transform(pixels, size, 2, 2, reflect, reflect);
+                transform(pixels, size, 2, 2, 0, reflect);
+                transform(pixels, size, 2, 2, reflect, 0);
             }
             break;
         case 3: // diagonal symmetry %
             if (rot_vs_ref) { // forward '/'
-                for (int x = 0; x < GENERATED_SIZE; x++) {
-                    for (int y = 0; y < GENERATED_SIZE; y++) {
-                        pixels[x + Y(y)] = pixels[reflect - y + Y(reflect - x)];
+                for (int x = 0; x < size; x++) {
+                    for (int y = 0; y < size; y++) {
+                        pixels[x + Y(y, size)] 
+                            = pixels[reflect - y + Y(reflect - x, size)];
                     }
                 }
             } else { // backward '\'
-                for (int x = 0; x < GENERATED_SIZE; x++) {
-                    for (int y = 0; y < GENERATED_SIZE; y++) {
-                        pixels[x + Y(y)] = pixels[y + Y(x)];
+                for (int x = 0; x < size; x++) {
+                    for (int y = 0; y < size; y++) {
+                        pixels[x + Y(y, size)] = pixels[y + Y(x, size)];
                     }
                 }
             }
             break;
     }
 }
+
+void artifact_srand(ArtifactRand *rng, uint32_t seed) {
+    seed_state(rng->state, seed);
+    rng->front = 3;
+    rng->rear = 0;
+    // discard initial output, like glibc does
+    for (int i = 0; i < RAND_DISCARD; i++) {
+        artifact_rand(rng);
+    }
+}
+
+int artifact_rand(ArtifactRand *rng) {
+    uint32_t val = rng->state[rng->front] += rng->state[rng->rear];
+    if (++rng->front >= ARTIFACT_RAND_DEG) rng->front = 0;
+    if (++rng->rear >= ARTIFACT_RAND_DEG) rng->rear = 0;
+    return val >> 1;
+}
+
+void generate_artifact(int *pixels, int id) {
+    ArtifactRand rng;
+    generate_artifact_r(pixels, id, &rng);
+}
+
+// symmetries generate_artifact() draws from, numbered sym_type | rot_vs_ref
+// << 2 (like PackedArtifact's sym)
+#define DRAWN_SYMMETRIES 8
+
+/* every symmetry as a permutation of pixels: pixel i of the symmetric image 
+ * is pixel table[i] of the one before. 
+ */
+typedef struct SymmetryTables {
+    uint16_t drawn[DRAWN_SYMMETRIES][ARTIFACT_MAX_SIZE * ARTIFACT_MAX_SIZE];
+    uint16_t d4[ARTIFACT_MAX_SIZE * ARTIFACT_MAX_SIZE];
+} SymmetryTables;
+
+static SymmetryTables symmetry_tables[3]; // of sizes 8, 16 and 32
+static pthread_once_t symmetry_once = PTHREAD_ONCE_INIT;
+
+/* returns the tables for artifacts of the given (supported) size. */
+static const SymmetryTables *tables_for(int size) {
+    return &symmetry_tables[size == 8 ? 0 : (size == 16 ? 1 : 2)];
+}
+
+/* fills in symmetry_tables. the drawn symmetries are whatever symmetrize() 
+ * does to an image of pixel indices.
+ */
+static void build_symmetry_tables(void) {
+    static int pixels[ARTIFACT_MAX_SIZE * ARTIFACT_MAX_SIZE];
+    for (int size = 8; size <= ARTIFACT_MAX_SIZE; size *= 2) {
+        SymmetryTables *tables = (SymmetryTables *) tables_for(size);
+        for (int sym = 0; sym < DRAWN_SYMMETRIES; sym++) {
+            for (int i = 0; i < size * size; i++) pixels[i] = i;
+            symmetrize(pixels, size, sym & 3, sym >> 2);
+            for (int i = 0; i < size * size; i++) {
+                tables->drawn[sym][i] = pixels[i];
+            }
+        }
+        // all 8 rotations and reflections: fold every pixel into the 
+        // triangle y <= x of the top left quadrant
+        for (int x = 0; x < size; x++) {
+            for (int y = 0; y < size; y++) {
+                int fx = x < size / 2 ? x : size - 1 - x;
+                int fy = y < size / 2 ? y : size - 1 - y;
+                if (fy > fx) {
+                    int t = fx;
+                    fx = fy;
+                    fy = t;
+                }
+                tables->d4[x + Y(y, size)] = fx + Y(fy, size);
+            }
+        }
+    }
+}
+
+/* returns the permutation for an artifact with the given drawn symmetry.
+ *
+ * symmetry - ARTIFACT_SYM_*, the mode that may override the drawn one
+ */
+static const uint16_t *symmetry_table(int size, int symmetry, int drawn) {
+    pthread_once(&symmetry_once, build_symmetry_tables);
+    const SymmetryTables *tables = tables_for(size);
+    switch (symmetry) {
+        case ARTIFACT_SYM_D4: return tables->d4;
+        case ARTIFACT_SYM_ROT4: return tables->drawn[2 | 1 << 2];
+        case ARTIFACT_SYM_POINT: return tables->drawn[0 | 1 << 2];
+        default: return tables->drawn[drawn];
+    }
+}
+
+/* applies a symmetry table in one pass, from the pixels in src. */
+static ALWAYS_INLINE void gather(int *pixels, const int *src, 
+        const uint16_t *table, int size) {
+    for (int i = 0; i < size * size; i++) {
+        pixels[i] = src[table[i]];
+    }
+}
+
+/* draws the next random number of the id, by the given version: from the
+ * rng for v1, or draw index (counting up) for v2.
+ */
+static ALWAYS_INLINE int next_draw(ArtifactRand *rng, uint32_t id, 
+        int version, uint32_t *index) {
+    if (version == ARTIFACT_V2) return artifact_draw_v2(id, (*index)++);
+    return artifact_rand(rng);
+}
+
+/* generates an artifact one draw at a time, the way it always has been: 
+ * filled in place and then symmetrized by symmetrize() itself, not by the
+ * symmetry tables the other paths use, so it's something to check them
+ * against. generate_artifact_r() and generate_artifact_v2() are this with
+ * their version.
+ */
+static ALWAYS_INLINE void generate_reference(int *pixels, int id, 
+        int version, ArtifactRand *rng) {
+    const int size = GENERATED_SIZE;
+    uint32_t index = 0;
+    if (version == ARTIFACT_V1) artifact_srand(rng, id);
+
+    // randomly fill in pixels (0->transparent, 1->placeholder pixel)
+    for (int x = 0; x < size; x++) {
+        for (int y = 0; y < size; y++) {
+            int draw = next_draw(rng, id, version, &index);
+            if ((draw & 3) <= 1) pixels[x + Y(y, size)] = 1;
+            else pixels[x + Y(y, size)] = 0;
+        }
+    }
+
+    // randomly assign two colors
+    int col1 = next_draw(rng, id, version, &index);
+    int col2 = next_draw(rng, id, version, &index);
+    for (int x = 0; x < size; x++) {
+        for (int y = 0; y < size; y++) {
+            if (pixels[x + Y(y, size)] != 0) {
+                int draw = next_draw(rng, id, version, &index);
+                if (draw & 1) pixels[x + Y(y, size)] = col1;
+                else pixels[x + Y(y, size)] = col2; 
+            }
+        }
+    }
+    
+    // determine symmetry (rotate or reflect some quadrant(s) of sprite)
+    int sym_type = (next_draw(rng, id, version, &index) & 3);
+    int rot_vs_ref = (next_draw(rng, id, version, &index) & 1); 
+    symmetrize(pixels, size, sym_type, rot_vs_ref);
+}
+
+void generate_artifact_r(int *pixels, int id, ArtifactRand *rng) {
+    generate_reference(pixels, id, ARTIFACT_V1, rng);
+}
+
+void generate_artifact_v2(int *pixels, int id) {
+    generate_reference(pixels, id, ARTIFACT_V2, NULL);
+}
+
+/* builds an artifact of the given size from already drawn random numbers. 
+ * does the same as generate_artifact_r() after seeding, at any size and 
+ * with any symmetry mode.
+ *
+ * draws - rand() results in the order they are drawn, stride apart
+ */
+static ALWAYS_INLINE void build_sized(int *pixels, const uint32_t *draws, 
+        int stride, int symmetry, int size) {
+    const uint32_t *picks = draws + stride * (size * size + 2);
+    int col1 = draws[stride * size * size];
+    int col2 = draws[stride * (size * size + 1)];
+    int filled[size * size];
+    int k = 0; // next fill draw
+    int c = 0; // next color pick
+    for (int x = 0; x < size; x++) {
+        for (int y = 0; y < size; y++) {
+            if ((draws[stride * k++] & 3) <= 1) {
+                filled[x + Y(y, size)] = (picks[stride * c++] & 1) ? col1 
+                    : col2;
+            } else {
+                filled[x + Y(y, size)] = 0;
+            }
+        }
+    }
+    int sym_type = (picks[stride * c] & 3);
+    int rot_vs_ref = (picks[stride * (c + 1)] & 1);
+    gather(pixels, filled, symmetry_table(size, symmetry, 
+        sym_type | rot_vs_ref << 2), size);
+}
+
+/* build_sized() for each supported size, with the size constant-folded. */
+static void build_8(int *pixels, const uint32_t *draws, int stride, 
+        int symmetry) {
+    build_sized(pixels, draws, stride, symmetry, 8);
+}
+
+static void build_16(int *pixels, const uint32_t *draws, int stride, 
+        int symmetry) {
+    build_sized(pixels, draws, stride, symmetry, 16);
+}
+
+static void build_32(int *pixels, const uint32_t *draws, int stride, 
+        int symmetry) {
+    build_sized(pixels, draws, stride, symmetry, 32);
+}
+
+typedef void (*Builder)(int *pixels, const uint32_t *draws, int stride, 
+    int symmetry);
+
+/* returns the builder for artifacts of the given size. */
+static Builder sized_builder(int size) {
+    return size == 8 ? build_8 : (size == 16 ? build_16 : build_32);
+}
+
+/* returns whether the artifacts of the given format are 8x8 with their drawn
+ * symmetry, which have the packed path (of either version).
+ */
+static bool is_packable(const ArtifactFormat *format) {
+    return format->size == GENERATED_SIZE 
+        && format->symmetry == ARTIFACT_SYM_DRAWN;
+}
+
+bool artifact_size_supported(int size) {
+    return size == 8 || size == 16 || size == 32;
+}
+
+static const char *SYMMETRY_NAMES[ARTIFACT_SYMMETRIES] = {
+    "drawn", "d4", "rot4", "point"
+};
+
+int artifact_symmetry_by_name(const char *name) {
+    for (int i = 0; i < ARTIFACT_SYMMETRIES; i++) {
+        if (strcmp(name, SYMMETRY_NAMES[i]) == 0) return i;
+    }
+    return -1;
+}
+
+static const char *VERSION_NAMES[ARTIFACT_VERSIONS] = {"v1", "v2"};
+
+int artifact_version_by_name(const char *name) {
+    for (int i = 0; i < ARTIFACT_VERSIONS; i++) {
+        if (strcmp(name, VERSION_NAMES[i]) == 0) return i;
+    }
+    return -1;
+}
+
+const char *artifact_version_name(int version) {
+    return VERSION_NAMES[version];
+}
+
+// SplitMix64's increment (2^64 over the golden ratio) and its finalizer's 
+// multipliers
+#define SPLITMIX_GAMMA 0x9e3779b97f4a7c15ull
+#define SPLITMIX_MUL1 0xbf58476d1ce4e5b9ull
+#define SPLITMIX_MUL2 0x94d049bb133111ebull
+
+uint32_t artifact_draw_v2(uint32_t id, uint32_t index) {
+    uint64_t z = ((uint64_t) id << 32) + (index + 1ull) * SPLITMIX_GAMMA;
+    z = (z ^ (z >> 30)) * SPLITMIX_MUL1;
+    z = (z ^ (z >> 27)) * SPLITMIX_MUL2;
+    return (z ^ (z >> 31)) >> 33;
+}
+
+/* draws the first count random numbers of the id by the given version. */
+static void draw_numbers(uint32_t *draws, uint32_t id, int count, 
+        int version) {
+    if (version == ARTIFACT_V2) {
+        for (int k = 0; k < count; k++) {
+            draws[k] = artifact_draw_v2(id, k);
+        }
+        return;
+    }
+    ArtifactRand rng;
+    artifact_srand(&rng, id);
+    for (int k = 0; k < count; k++) {
+        draws[k] = artifact_rand(&rng);
+    }
+}
+
+void generate_artifact_format(int *pixels, int id, 
+        const ArtifactFormat *format) {
+    if (is_packable(format)) {
+        PackedArtifact packed;
+        generate_artifact_packed(&packed, id, format->version);
+        expand_artifact(&packed, pixels);
+        return;
+    }
+    uint32_t draws[SIZED_DRAWS(ARTIFACT_MAX_SIZE)];
+    draw_numbers(draws, id, SIZED_DRAWS(format->size), format->version);
+    sized_builder(format->size)(pixels, draws, 1, format->symmetry);
+}
+
+// pixels of the left half, top half and top left quadrant in a bitmask
+#define BITS_LEFT 0x0f0f0f0f0f0f0f0full
+#define BITS_TOP 0x00000000ffffffffull
+#define BITS_TOP_LEFT (BITS_LEFT & BITS_TOP)
+// pixels on and above the diagonal '\' (y <= x) and below '/' (x + y >= 7)
+#define BITS_UPPER 0x80c0e0f0f8fcfeffull
+#define BITS_LOWER 0xfffefcf8f0e0c080ull
+
+/* mirrors an 8x8 bitmask horizontally (x -> 7 - x). */
+static inline uint64_t flip_x(uint64_t bits) {
+    bits = ((bits >> 1) & 0x5555555555555555ull) 
+        | ((bits & 0x5555555555555555ull) << 1);
+    bits = ((bits >> 2) & 0x3333333333333333ull) 
+        | ((bits & 0x3333333333333333ull) << 2);
+    bits = ((bits >> 4) & 0x0f0f0f0f0f0f0f0full) 
+        | ((bits & 0x0f0f0f0f0f0f0f0full) << 4);
+    return bits;
+}
+
+/* mirrors an 8x8 bitmask vertically (y -> 7 - y). */
+static inline uint64_t flip_y(uint64_t bits) {
+    bits = ((bits >> 8) & 0x00ff00ff00ff00ffull) 
+        | ((bits & 0x00ff00ff00ff00ffull) << 8);
+    bits = ((bits >> 16) & 0x0000ffff0000ffffull) 
+        | ((bits & 0x0000ffff0000ffffull) << 16);
+    return (bits >> 32) | (bits << 32);
+}
+
+/* swaps x and y of an 8x8 bitmask. */
+static inline uint64_t transpose(uint64_t bits) {
+    uint64_t t;
+    t = 0x0f0f0f0f00000000ull & (bits ^ (bits << 28));
+    bits ^= t ^ (t >> 28);
+    t = 0x3333000033330000ull & (bits ^ (bits << 14));
+    bits ^= t ^ (t >> 14);
+    t = 0x5500550055005500ull & (bits ^ (bits << 7));
+    bits ^= t ^ (t >> 7);
+    return bits;
+}
+
+uint64_t orient_bits(uint64_t bits, int orientation) {
+    if (orientation & 4) bits = transpose(bits);
+    if (orientation & 2) bits = flip_y(bits);
+    if (orientation & 1) bits = flip_x(bits);
+    return bits;
+}
+
+/* does the same as symmetrize() to an 8x8 bitmask. */
+static uint64_t symmetrize_bits(uint64_t bits, int sym_type, int rot_vs_ref) {
+    switch (sym_type) {
+        case 0: // vertical symmetry ||
+            bits &= BITS_LEFT;
+            if (rot_vs_ref) return bits | flip_x(flip_y(bits));
+            return bits | flip_x(bits);
+        case 1: // horizontal symmetry =
+            bits &= BITS_TOP;
+            if (rot_vs_ref) return bits | flip_x(flip_y(bits));
+            return bits | flip_y(bits);
+        case 2: // quadrant symmetry ::
+            bits &= BITS_TOP_LEFT;
+            if (rot_vs_ref) {
+                uint64_t t = transpose(bits);
+                return bits | flip_x(t) | flip_x(flip_y(bits)) | flip_y(t);
+            }
+            return bits | flip_x(bits) | flip_y(bits) | flip_x(flip_y(bits));
+        default: // diagonal symmetry %
+            if (rot_vs_ref) { // forward '/'
+                bits &= BITS_LOWER;
+                return bits | flip_x(flip_y(transpose(bits)));
+            }
+            // backward '\'
+            bits &= BITS_UPPER;
+            return bits | transpose(bits);
+    }
+}
+
+/* builds a packed artifact from already drawn random numbers. does the same 
+ * as generate_artifact_r() after seeding.
+ *
+ * draws - rand() results in the order they are drawn, stride apart
+ */
+static void build_packed(PackedArtifact *artifact, const uint32_t *draws, 
+        int stride) {
+    const uint32_t *picks = draws + stride * (8 * 8 + 2);
+
+    // gather the color picks up front so the loop below doesn't wait on loads
+    uint64_t pick_bits = 0;
+    for (int i = 0; i < 8 * 8; i++) {
+        pick_bits |= (uint64_t) (picks[stride * i] & 1) << i;
+    }
+
+    // fill and color in one (branchless) pass, the draws are too random for
+    // branches to be predicted
+    uint64_t mask = 0;
+    uint64_t select = 0;
+    int k = 0; // next fill draw
+    int c = 0; // next color pick
+    for (int x = 0; x < 8; x++) {
+        for (int y = 0; y < 8; y++) {
+            uint64_t filled = ((draws[stride * k++] & 3) <= 1);
+            uint64_t pick = (pick_bits >> c) & filled;
+            mask |= filled << (x + 8 * y);
+            select |= pick << (x + 8 * y);
+            c += filled;
+        }
+    }
+
+    int sym_type = (picks[stride * c] & 3);
+    int rot_vs_ref = (picks[stride * (c + 1)] & 1);
+    artifact->mask = symmetrize_bits(mask, sym_type, rot_vs_ref);
+    artifact->select = symmetrize_bits(select, sym_type, rot_vs_ref);
+    artifact->col1 = draws[stride * 8 * 8];
+    artifact->col2 = draws[stride * (8 * 8 + 1)];
+    artifact->sym = sym_type | (rot_vs_ref << 2);
+}
+
+void generate_artifact_packed(PackedArtifact *artifact, int id, int version) {
+    uint32_t draws[MAX_DRAWS];
+    draw_numbers(draws, id, MAX_DRAWS, version);
+    build_packed(artifact, draws, 1);
+}
+
+void expand_artifact(const PackedArtifact *artifact, int *pixels) {
+    for (int i = 0; i < 8 * 8; i++) {
+        int col = ((artifact->select >> i) & 1) ? artifact->col1 
+            : artifact->col2;
+        pixels[i] = ((artifact->mask >> i) & 1) ? col : 0;
+    }
+}
+
+void expand_artifact_rgba(const PackedArtifact *artifact, uint32_t *pixels, 
+        uint32_t alpha_mask) {
+    // like the colors in expand_artifact(), made opaque
+    uint32_t col1 = artifact->col1 ? (artifact->col1 | alpha_mask) : 0;
+    uint32_t col2 = artifact->col2 ? (artifact->col2 | alpha_mask) : 0;
+    for (int i = 0; i < 8 * 8; i++) {
+        uint32_t col = ((artifact->select >> i) & 1) ? col1 : col2;
+        pixels[i] = ((artifact->mask >> i) & 1) ? col : 0;
+    }
+}
+
+#ifdef __GNUC__
+// one random number generator per lane (GCC vector extension, compiled into
+// SSE2/AVX2/AVX-512 instructions depending on the target)
+typedef uint32_t Lanes __attribute__((vector_size(
+    ARTIFACT_BATCH_LANES * sizeof(uint32_t))));
+typedef int32_t SignedLanes __attribute__((vector_size(
+    ARTIFACT_BATCH_LANES * sizeof(int32_t))));
+typedef int64_t WideLanes __attribute__((vector_size(
+    ARTIFACT_BATCH_LANES * sizeof(int64_t))));
+typedef uint64_t CounterLanes __attribute__((vector_size(
+    ARTIFACT_BATCH_LANES * sizeof(uint64_t))));
+
+// let x86-64 builds pick the widest vector instructions at runtime
+#if defined(__x86_64__) && defined(__linux__) && !defined(__clang__)
+#define BATCH_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define BATCH_CLONES
+#endif
+
+/* advances the generator of every lane by one full cycle of its state, which
+ * is ARTIFACT_RAND_DEG numbers when starting with front = 3 and rear = 0.
+ *
+ * out - receives the drawn numbers (before the final shift), or NULL
+ */
+static inline void rand_cycle(Lanes *state, Lanes *out) {
+    for (int i = 0; i < ARTIFACT_RAND_DEG - 3; i++) {
+        state[i + 3] += state[i];
+        if (out) out[i] = state[i + 3];
+    }
+    for (int i = ARTIFACT_RAND_DEG - 3; i < ARTIFACT_RAND_DEG; i++) {
+        state[i - (ARTIFACT_RAND_DEG - 3)] += state[i];
+        if (out) out[i] = state[i - (ARTIFACT_RAND_DEG - 3)];
+    }
+}
+
+// full generator cycles needed to cover the draws of an artifact
+#define SIZED_CYCLES(size) \
+    ((SIZED_DRAWS(size) + ARTIFACT_RAND_DEG - 1) / ARTIFACT_RAND_DEG)
+#define DRAW_CYCLES SIZED_CYCLES(8)
+
+/* does the same as seed_state() for one generator per lane, seeded with
+ * consecutive ids starting at first_id.
+ */
+static inline void seed_lanes(Lanes *state, uint32_t first_id) {
+    const int64_t m = 2147483647;
+    Lanes seed;
+    for (int lane = 0; lane < ARTIFACT_BATCH_LANES; lane++) {
+        seed[lane] = first_id + lane;
+    }
+    seed += (Lanes) (seed == 0) & 1;
+    state[0] = seed;
+
+    // word = (16807 * word) % m in 64-bit lanes instead of Schrage's method.
+    // adding a multiple of m keeps the (possibly negative) product positive
+    WideLanes word = __builtin_convertvector((SignedLanes) seed, WideLanes);
+    for (int i = 1; i < ARTIFACT_RAND_DEG; i++) {
+        word = word * 16807 + 16808 * m;
+        word = (word & m) + (word >> 31);
+        word -= (word >= m) & m;
+        state[i] = __builtin_convertvector(word, Lanes);
+    }
+}
+
+/* seeds one generator per lane with consecutive ids starting at first_id and
+ * draws the given cycles of numbers (to build their artifacts) into draws.
+ */
+BATCH_CLONES
+static void batch_rand(Lanes *draws, uint32_t first_id, int cycles) {
+    Lanes state[ARTIFACT_RAND_DEG];
+    seed_lanes(state, first_id);
+    for (int i = 0; i < RAND_DISCARD / ARTIFACT_RAND_DEG; i++) {
+        rand_cycle(state, NULL);
+    }
+    for (int i = 0; i < cycles; i++) {
+        rand_cycle(state, draws + i * ARTIFACT_RAND_DEG);
+    }
+    for (int i = 0; i < cycles * ARTIFACT_RAND_DEG; i++) {
+        draws[i] >>= 1;
+    }
+}
+
+/* sets the SplitMix64 seeds of consecutive ids starting at first_id, one
+ * per lane, like artifact_draw_v2() seeds them.
+ */
+static inline void seed_counters(CounterLanes *seeds, uint32_t first_id) {
+    for (int lane = 0; lane < ARTIFACT_BATCH_LANES; lane++) {
+        (*seeds)[lane] = (uint64_t) (uint32_t) (first_id + lane) << 32;
+    }
+}
+
+/* does artifact_draw_v2() of the given index for the seed of each lane. */
+static inline void draw_counters(const CounterLanes *seeds, uint32_t index,
+        Lanes *draw) {
+    CounterLanes z = *seeds + (index + 1ull) * SPLITMIX_GAMMA;
+    z = (z ^ (z >> 30)) * SPLITMIX_MUL1;
+    z = (z ^ (z >> 27)) * SPLITMIX_MUL2;
+    *draw = __builtin_convertvector((z ^ (z >> 31)) >> 33, Lanes);
+}
+
+/* like batch_rand(), for generator v2: draws the first count numbers. */
+BATCH_CLONES
+static void batch_draw_v2(Lanes *draws, uint32_t first_id, int count) {
+    CounterLanes seeds;
+    seed_counters(&seeds, first_id);
+    for (int k = 0; k < count; k++) {
+        draw_counters(&seeds, k, &draws[k]);
+    }
+}
+
+/* draws the first count numbers of consecutive ids starting at first_id, 
+ * one id per lane, by the given version. draws must have room for whole
+ * cycles of v1's generator.
+ */
+static void batch_draws(Lanes *draws, uint32_t first_id, int count,
+        int version) {
+    if (version == ARTIFACT_V2) {
+        batch_draw_v2(draws, first_id, count);
+    } else {
+        batch_rand(draws, first_id, 
+            (count + ARTIFACT_RAND_DEG - 1) / ARTIFACT_RAND_DEG);
+    }
+}
+
+void generate_artifacts_packed(PackedArtifact *artifacts, uint32_t first_id,
+        int count, int version) {
+    Lanes draws[DRAW_CYCLES * ARTIFACT_RAND_DEG];
+    for (int i = 0; i < count; i += ARTIFACT_BATCH_LANES) {
+        batch_draws(draws, first_id + i, MAX_DRAWS, version);
+        int n = count - i;
+        if (n > ARTIFACT_BATCH_LANES) n = ARTIFACT_BATCH_LANES;
+        for (int lane = 0; lane < n; lane++) {
+            build_packed(&artifacts[i + lane], (const uint32_t *) draws + lane, 
+                ARTIFACT_BATCH_LANES);
+        }
+    }
+}
+
+/* generates up to ARTIFACT_BATCH_LANES artifacts of a format other than the
+ * default one after another into pixels.
+ */
+static void generate_batch_format(int *pixels, uint32_t first_id, int count,
+        const ArtifactFormat *format) {
+    static _Thread_local Lanes draws[SIZED_CYCLES(ARTIFACT_MAX_SIZE) 
+        * ARTIFACT_RAND_DEG]; // too big for small thread stacks
+    const int size = format->size;
+    Builder build = sized_builder(size);
+    batch_draws(draws, first_id, SIZED_DRAWS(size), format->version);
+    for (int lane = 0; lane < count; lane++) {
+        build(pixels + lane * size * size, (const uint32_t *) draws + lane, 
+            ARTIFACT_BATCH_LANES, format->symmetry);
+    }
+}
+#else
+void generate_artifacts_packed(PackedArtifact *artifacts, uint32_t first_id,
+        int count, int version) {
+    for (int i = 0; i < count; i++) {
+        generate_artifact_packed(&artifacts[i], first_id + i, version);
+    }
+}
+
+static void generate_batch_format(int *pixels, uint32_t first_id, int count,
+        const ArtifactFormat *format) {
+    const int area = format->size * format->size;
+    for (int i = 0; i < count; i++) {
+        generate_artifact_format(pixels + i * area, first_id + i, format);
+    }
+}
+#endif
+
+void generate_artifacts(int *pixels, uint32_t first_id, int count) {
+    const int area = GENERATED_SIZE * GENERATED_SIZE;
+    PackedArtifact packed[ARTIFACT_BATCH_LANES];
+    for (int i = 0; i < count; i += ARTIFACT_BATCH_LANES) {
+        int n = count - i;
+        if (n > ARTIFACT_BATCH_LANES) n = ARTIFACT_BATCH_LANES;
+        generate_artifacts_packed(packed, first_id + i, n, ARTIFACT_V1);
+        for (int j = 0; j < n; j++) {
+            expand_artifact(&packed[j], pixels + (i + j) * area);
+        }
+    }
+}
+
+void generate_artifacts_rgba(uint32_t *pixels, uint32_t first_id, int count,
+        const ArtifactFormat *format, uint32_t alpha_mask) {
+    const int area = format->size * format->size;
+    if (is_packable(format)) {
+        PackedArtifact packed[ARTIFACT_BATCH_LANES];
+        for (int i = 0; i < count; i += ARTIFACT_BATCH_LANES) {
+            int n = count - i;
+            if (n > ARTIFACT_BATCH_LANES) n = ARTIFACT_BATCH_LANES;
+            generate_artifacts_packed(packed, first_id + i, n, 
+                format->version);
+            for (int j = 0; j < n; j++) {
+                expand_artifact_rgba(&packed[j], pixels + (i + j) * area, 
+                    alpha_mask);
+            }
+        }
+        return;
+    }
+    for (int i = 0; i < count; i += ARTIFACT_BATCH_LANES) {
+        int n = count - i;
+        if (n > ARTIFACT_BATCH_LANES) n = ARTIFACT_BATCH_LANES;
+        int *batch = (int *) pixels + i * area;
+        generate_batch_format(batch, first_id + i, n, format);
+        // like expand_artifact_rgba(), in place
+        for (int j = 0; j < n * area; j++) {
+            pixels[i * area + j] = batch[j] ? (batch[j] | alpha_mask) : 0;
+        }
+    }
+}
+
+// modulus of the seeded words after the first, which are seed * 16807^i
+#define RAND_MODULUS 2147483647
+
+/* once seeded, the generator only adds words, so every number it draws is 
+ * the same sum of multiples of the seeded words for all seeds. 
+ */
+typedef struct LookupTables {
+    // the multiples for each fill draw, mod 8 (all its bit 2 depends on)
+    uint16_t fill_multiples[8 * 8][ARTIFACT_RAND_DEG];
+    uint32_t seed_factors[ARTIFACT_RAND_DEG]; // 16807^i mod RAND_MODULUS
+} LookupTables;
+
+static LookupTables lookup_tables;
+static pthread_once_t lookup_once = PTHREAD_ONCE_INIT;
+
+/* fills in lookup_tables by running the generator on the multiples. */
+static void build_lookup_tables(void) {
+    static uint32_t words[ARTIFACT_RAND_DEG][ARTIFACT_RAND_DEG];
+    for (int i = 0; i < ARTIFACT_RAND_DEG; i++) words[i][i] = 1;
+    int front = 3; // like artifact_srand()
+    int rear = 0;
+    for (int n = 0; n < RAND_DISCARD + 8 * 8; n++) {
+        for (int i = 0; i < ARTIFACT_RAND_DEG; i++) {
+            words[front][i] += words[rear][i];
+            if (n >= RAND_DISCARD) {
+                lookup_tables.fill_multiples[n - RAND_DISCARD][i] 
+                    = words[front][i] & 7;
+            }
+        }
+        if (++front >= ARTIFACT_RAND_DEG) front = 0;
+        if (++rear >= ARTIFACT_RAND_DEG) rear = 0;
+    }
+    uint64_t factor = 1;
+    for (int i = 0; i < ARTIFACT_RAND_DEG; i++) {
+        lookup_tables.seed_factors[i] = factor;
+        factor = factor * 16807 % RAND_MODULUS;
+    }
+}
+
+void prepare_lookup(ArtifactLookup *lookup, const uint32_t *pixels, 
+        uint32_t alpha_mask, int version) {
+    memcpy(lookup->pixels, pixels, sizeof(lookup->pixels));
+    lookup->alpha_mask = alpha_mask;
+    lookup->version = version;
+    lookup->possible = 0;
+    lookup->checks = 0;
+
+    // an artifact has at most two colors
+    uint32_t colors[2];
+    int color_count = 0;
+    for (int i = 0; i < 8 * 8; i++) {
+        if (pixels[i] == 0) continue;
+        if (color_count > 0 && pixels[i] == colors[0]) continue;
+        if (color_count > 1 && pixels[i] == colors[1]) continue;
+        if (color_count == 2) return;
+        colors[color_count++] = pixels[i];
+    }
+
+    // every symmetry copies pixels from ones that stay as they are, so the
+    // image can only have the ones where all copies agree
+    const uint16_t *tables[DRAWN_SYMMETRIES];
+    for (int sym = 0; sym < DRAWN_SYMMETRIES; sym++) {
+        tables[sym] = symmetry_table(8, ARTIFACT_SYM_DRAWN, sym);
+        bool agrees = true;
+        for (int i = 0; i < 8 * 8; i++) {
+            agrees = agrees && pixels[i] == pixels[tables[sym][i]];
+        }
+        if (agrees) lookup->possible |= 1 << sym;
+    }
+
+    // the fill draws of pixels that stay under the most possible symmetries
+    // rule out the most, so they're checked first
+    uint8_t symmetries[8 * 8];
+    for (int k = 0; k < 8 * 8; k++) {
+        const int pixel = k / 8 + Y(k % 8, 8); // drawn column by column
+        symmetries[k] = 0;
+        for (int sym = 0; sym < DRAWN_SYMMETRIES; sym++) {
+            if ((lookup->possible >> sym & 1) && tables[sym][pixel] == pixel) {
+                symmetries[k] |= 1 << sym;
+            }
+        }
+    }
+    for (int ruled = DRAWN_SYMMETRIES; ruled > 0; ruled--) {
+        for (int k = 0; k < 8 * 8; k++) {
+            if (__builtin_popcount(symmetries[k]) != ruled) continue;
+            const int c = lookup->checks++;
+            lookup->draws[c] = k;
+            lookup->filled[c] = pixels[k / 8 + Y(k % 8, 8)] != 0;
+            lookup->symmetries[c] = symmetries[k];
+        }
+    }
+}
+
+/* returns whether the artifact of the id has exactly the looked up pixels. */
+static bool lookup_matches(const ArtifactLookup *lookup, uint32_t id) {
+    PackedArtifact artifact;
+    uint32_t pixels[8 * 8];
+    generate_artifact_packed(&artifact, id, lookup->version);
+    expand_artifact_rgba(&artifact, pixels, lookup->alpha_mask);
+    return memcmp(pixels, lookup->pixels, sizeof(pixels)) == 0;
+}
+
+#ifdef __GNUC__
+typedef uint16_t ShortLanes __attribute__((vector_size(
+    ARTIFACT_BATCH_LANES * sizeof(uint16_t))));
+
+/* returns whether any lane is not 0. */
+static inline bool any_lane(const ShortLanes *lanes) {
+    uint32_t any = 0;
+    for (int lane = 0; lane < ARTIFACT_BATCH_LANES; lane++) {
+        any |= (*lanes)[lane];
+    }
+    return any != 0;
+}
+
+/* adds the ids of the lanes (starting at first_id) that are still alive and
+ * do match to ids, up to the first count. returns the ids found so far.
+ */
+static int add_matches(const ArtifactLookup *lookup, uint32_t first_id,
+        const ShortLanes *alive, uint64_t count, uint32_t *ids, int capacity, 
+        int found) {
+    for (int lane = 0; lane < ARTIFACT_BATCH_LANES; lane++) {
+        if ((*alive)[lane] == 0 || (uint64_t) lane >= count) continue;
+        const uint32_t id = first_id + lane;
+        if (!lookup_matches(lookup, id)) continue;
+        if (found < capacity) ids[found] = id;
+        found++;
+    }
+    return found;
+}
+
+/* lookup_artifacts() for ids from 1 to 2^31 - 1 or from 2^31 on. the seed 
+ * is signed, so within either each seeded word grows by the same step 
+ * (mod RAND_MODULUS) from one id to the next.
+ *
+ * found - ids found so far
+ */
+BATCH_CLONES
+static int lookup_linear(const ArtifactLookup *lookup, uint32_t first_id, 
+        uint64_t count, uint32_t *ids, int capacity, int found) {
+    const LookupTables *tables = &lookup_tables;
+    Lanes words[ARTIFACT_RAND_DEG];
+    uint32_t steps[ARTIFACT_RAND_DEG];
+    for (int lane = 0; lane < ARTIFACT_BATCH_LANES; lane++) {
+        const int64_t seed = (int32_t) (first_id + lane);
+        words[0][lane] = first_id + lane;
+        for (int i = 1; i < ARTIFACT_RAND_DEG; i++) {
+            int64_t word = seed * tables->seed_factors[i] % RAND_MODULUS;
+            words[i][lane] = word < 0 ? word + RAND_MODULUS : word;
+        }
+    }
+    steps[0] = ARTIFACT_BATCH_LANES;
+    for (int i = 1; i < ARTIFACT_RAND_DEG; i++) {
+        steps[i] = (uint64_t) ARTIFACT_BATCH_LANES * tables->seed_factors[i]
+            % RAND_MODULUS;
+    }
+
+    for (uint64_t i = 0; i < count; i += ARTIFACT_BATCH_LANES) {
+        // the sums only need the low bits, which are quicker to multiply
+        ShortLanes low[ARTIFACT_RAND_DEG];
+        for (int w = 0; w < ARTIFACT_RAND_DEG; w++) {
+            low[w] = __builtin_convertvector(words[w], ShortLanes);
+        }
+        // possible symmetries left in each lane
+        ShortLanes alive = (ShortLanes) {0} + lookup->possible;
+        for (int c = 0; c < lookup->checks; c++) {
+            const uint16_t *multiples 
+                = tables->fill_multiples[lookup->draws[c]];
+            ShortLanes sum = low[0] * multiples[0];
+            for (int w = 1; w < ARTIFACT_RAND_DEG; w++) {
+                sum += low[w] * multiples[w];
+            }
+            // (draw & 3) <= 1 fills the pixel, so bit 2 is clear before the
+            // draw is shifted
+            ShortLanes wrong = (sum >> 2 & 1) ^ lookup->filled[c] ^ 1;
+            alive &= ~(-wrong & lookup->symmetries[c]);
+            if (!any_lane(&alive)) break;
+        }
+        found = add_matches(lookup, first_id + i, &alive, count - i, ids, 
+            capacity, found);
+        for (int w = 0; w < ARTIFACT_RAND_DEG; w++) {
+            words[w] += steps[w];
+            if (w > 0) {
+                words[w] -= (Lanes) (words[w] >= RAND_MODULUS) & RAND_MODULUS;
+            }
+        }
+    }
+    return found;
+}
+
+/* lookup_artifacts() for generator v2, which draws the fill numbers of each
+ * id directly.
+ */
+BATCH_CLONES
+static int lookup_counter(const ArtifactLookup *lookup, uint32_t first_id, 
+        uint64_t count, uint32_t *ids, int capacity) {
+    int found = 0;
+    for (uint64_t i = 0; i < count; i += ARTIFACT_BATCH_LANES) {
+        CounterLanes seeds;
+        seed_counters(&seeds, first_id + i);
+        ShortLanes alive = (ShortLanes) {0} + lookup->possible;
+        for (int c = 0; c < lookup->checks; c++) {
+            Lanes draw;
+            draw_counters(&seeds, lookup->draws[c], &draw);
+            ShortLanes empty = __builtin_convertvector(draw >> 1 & 1, 
+                ShortLanes);
+            ShortLanes wrong = empty ^ lookup->filled[c] ^ 1;
+            alive &= ~(-wrong & lookup->symmetries[c]);
+            if (!any_lane(&alive)) break;
+        }
+        found = add_matches(lookup, first_id + i, &alive, count - i, ids, 
+            capacity, found);
+    }
+    return found;
+}
+#else
+static int lookup_linear(const ArtifactLookup *lookup, uint32_t first_id, 
+        uint64_t count, uint32_t *ids, int capacity, int found) {
+    for (uint64_t i = 0; i < count; i++) {
+        if (!lookup_matches(lookup, first_id + i)) continue;
+        if (found < capacity) ids[found] = first_id + i;
+        found++;
+    }
+    return found;
+}
+
+static int lookup_counter(const ArtifactLookup *lookup, uint32_t first_id, 
+        uint64_t count, uint32_t *ids, int capacity) {
+    return lookup_linear(lookup, first_id, count, ids, capacity, 0);
+}
+#endif
+
+int lookup_artifacts(const ArtifactLookup *lookup, uint32_t first_id, 
+        uint64_t count, uint32_t *ids, int capacity) {
+    pthread_once(&lookup_once, build_lookup_tables);
+    int found = 0;
+    if (lookup->possible == 0) return 0;
+    if (lookup->version == ARTIFACT_V2) {
+        return lookup_counter(lookup, first_id, count, ids, capacity);
+    }
+    uint64_t id = first_id;
+    const uint64_t end = first_id + count;
+    // 0 is seeded as 1
+    if (id == 0 && id < end) {
+        if (lookup_matches(lookup, 0)) {
+            if (capacity > 0) ids[0] = 0;
+            found++;
+        }
+        id++;
+    }
+    while (id < end) {
+        const uint64_t half = 1ull << 31;
+        const uint64_t stop = id < half && end > half ? half : end;
+        found = lookup_linear(lookup, id, stop - id, ids, capacity, found);
+        id = stop;
+    }
+    return found;
+}
@@ -5,10 +5,81 @@
 #ifndef _GENERATOR_H_
 #define _GENERATOR_H_
 
-/* width and height in pixels of the generated artifacts. */
-extern const int GENERATED_SIZE;
+#include <stdbool.h>
+#include <stdint.h>
 
-/* Generates an artifact into the given pixel array.
+/* width and height in pixels of the generated artifacts (by default, see
+ * generate_artifact_format() for the others).
+ */
+#define GENERATED_SIZE 8
+
+/* largest size of artifacts that can be generated. */
+#define ARTIFACT_MAX_SIZE 32
+
+/* symmetry modes of artifacts. by default each artifact has the symmetry
+ * it draws, the others replace it for every artifact.
+ */
+enum {
+    ARTIFACT_SYM_DRAWN, // the drawn one (the default)
+    ARTIFACT_SYM_D4, // all 8 rotations and reflections
+    ARTIFACT_SYM_ROT4, // 4-fold rotation
+    ARTIFACT_SYM_POINT, // point reflection (2-fold rotation)
+    ARTIFACT_SYMMETRIES
+};
+
+/* versions of the generator. each draws different artifacts for the same 
+ * ids, so an id only names an artifact together with its version.
+ */
+enum {
+    ARTIFACT_V1, // glibc's rand() seeded with the id (the original)
+    ARTIFACT_V2, // counter-based, see artifact_draw_v2()
+    ARTIFACT_VERSIONS
+};
+
+/* size, symmetry and generator version of the artifacts to generate. */
+typedef struct ArtifactFormat {
+    int size; // 8 (GENERATED_SIZE), 16 or 32
+    int symmetry; // ARTIFACT_SYM_*
+    int version; // ARTIFACT_V*
+} ArtifactFormat;
+
+/* initializer of the default format, which generate_artifact() generates. */
+#define ARTIFACT_DEFAULT_FORMAT {.size = GENERATED_SIZE, \
+    .symmetry = ARTIFACT_SYM_DRAWN, .version = ARTIFACT_V1}
+
+/* number of words in the random number generator state. */
+#define ARTIFACT_RAND_DEG 31
+
+/* number of artifacts generate_artifacts() generates side by side. */
+#define ARTIFACT_BATCH_LANES 16
+
+/* an 8x8 artifact packed into bitmasks, where pixel (x, y) is bit x + y * 8.
+ * col1/col2 and sym are what generate_artifact() draws for them.
+ */
+typedef struct PackedArtifact {
+    uint64_t mask; // filled pixels
+    uint64_t select; // filled pixels colored col1 (the others are col2)
+    int32_t col1;
+    int32_t col2;
+    uint8_t sym; // symmetry: sym_type (0-3) | rot_vs_ref << 2
+} PackedArtifact;
+
+/* caller-owned random number generator state. reproduces the sequence of 
+ * glibc's srand()/rand() exactly, without any hidden or shared state.
+ */
+typedef struct ArtifactRand {
+    uint32_t state[ARTIFACT_RAND_DEG];
+    int front; // index of the next word to be updated
+    int rear; // index of the word it is updated with
+} ArtifactRand;
+
+/* seeds the random number generator (equivalent to srand(seed)). */
+void artifact_srand(ArtifactRand *rng, uint32_t seed);
+
+/* returns the next random number in [0, 2^31) (equivalent to rand()). */
+int artifact_rand(ArtifactRand *rng);
+
+/* Generates an artifact (of generator v1) into the given pixel array.
  *
  * pixels - the array of pixels to generate in (must be n x n, where 
  *      n = GENERATED_SIZE).
@@ -16,4 +87,153 @@ extern const int GENERATED_SIZE;
  */
 void generate_artifact(int *pixels, int id);
 
+/* Reentrant version of generate_artifact() which draws from the given random
+ * number generator state instead of a local one. Safe to call from multiple
+ * threads as long as each uses its own rng. The rng is reseeded with id.
+ * Applies the drawn symmetry with the original hand-written code, not the
+ * symmetry tables, so it's the baseline the other paths are checked against.
+ */
+void generate_artifact_r(int *pixels, int id, ArtifactRand *rng);
+
+/* Generates an artifact of generator v2 the way generate_artifact() does for
+ * v1: a draw at a time, symmetrized by the original code, none of the
+ * optimized paths or symmetry tables. What they are verified against.
+ * Thread-safe.
+ */
+void generate_artifact_v2(int *pixels, int id);
+
+/* returns whether artifacts of the given size can be generated: 8 (the 
+ * default), 16 or 32.
+ */
+bool artifact_size_supported(int size);
+
+/* returns the ARTIFACT_SYM_* mode of the given name ("drawn", "d4", "rot4" 
+ * or "point"), or -1 if there is none.
+ */
+int artifact_symmetry_by_name(const char *name);
+
+/* returns the ARTIFACT_V* version of the given name ("v1" or "v2"), or -1 if
+ * there is none.
+ */
+int artifact_version_by_name(const char *name);
+
+/* returns the name of an ARTIFACT_V* version. */
+const char *artifact_version_name(int version);
+
+/* Returns the random number of the given index that generator v2 draws for
+ * an id, in [0, 2^31) like rand(). Artifacts are built from the draws the 
+ * same way in both versions, but v2 computes each one directly: it is output
+ * index + 1 of SplitMix64 seeded with id * 2^32, so there is no warm-up, any 
+ * draw of any id costs the same, and only 64-bit integer math is involved
+ * (the same on every platform). The seeds are far enough apart that no two 
+ * ids share draws.
+ */
+uint32_t artifact_draw_v2(uint32_t id, uint32_t index);
+
+/* Generates an artifact of the given format (of a supported size). The 
+ * pixels are drawn the same way as by default, so the default format gives
+ * the same as generate_artifact(). Each size has its own specialized code, 
+ * so bigger artifacts only cost their extra pixels, and every symmetry is a
+ * precomputed permutation of pixels applied in one pass.
+ *
+ * pixels - array of size x size pixels
+ */
+void generate_artifact_format(int *pixels, int id, 
+    const ArtifactFormat *format);
+
+/* Generates an artifact like generate_artifact() (or like generator v2 
+ * does), packed into bitmasks. Only supports GENERATED_SIZE 8. Thread-safe.
+ *
+ * version - ARTIFACT_V*
+ */
+void generate_artifact_packed(PackedArtifact *artifact, int id, int version);
+
+/* Unpacks an artifact into the same pixels generate_artifact() gives. */
+void expand_artifact(const PackedArtifact *artifact, int *pixels);
+
+/* Unpacks an artifact into 32-bit RGBA pixels. Filled pixels get their color
+ * with alpha_mask set, the others are left fully transparent (0).
+ */
+void expand_artifact_rgba(const PackedArtifact *artifact, uint32_t *pixels, 
+    uint32_t alpha_mask);
+
+/* number of ways to rotate and/or mirror an artifact, including leaving it 
+ * as it is (orientation 0).
+ */
+#define ARTIFACT_ORIENTATIONS 8
+
+/* Rotates and/or mirrors an 8x8 bitmask (like PackedArtifact's masks).
+ *
+ * orientation - 0 to ARTIFACT_ORIENTATIONS - 1, bit 0 mirrors x, bit 1 
+ *      mirrors y and bit 2 swaps x and y first
+ */
+uint64_t orient_bits(uint64_t bits, int orientation);
+
+/* Like generate_artifacts(), but generates packed artifacts of the given 
+ * ARTIFACT_V* version.
+ */
+void generate_artifacts_packed(PackedArtifact *artifacts, uint32_t first_id, 
+    int count, int version);
+
+/* Generates count consecutive artifacts, starting at first_id, into pixels.
+ * Gives the same output as calling generate_artifact() for each id, but runs
+ * the random number generators of ARTIFACT_BATCH_LANES ids at once in SIMD 
+ * lanes (with a scalar fallback for compilers without vector extensions).
+ *
+ * pixels - array of count * n * n pixels (n = GENERATED_SIZE), filled with
+ *      one artifact after another
+ * first_id - id of the first artifact, the following ones wrap around 2^32
+ * count - number of artifacts to generate
+ */
+void generate_artifacts(int *pixels, uint32_t first_id, int count);
+
+/* Generates count consecutive artifacts of the given format, starting at 
+ * first_id, as 32-bit RGBA pixels like expand_artifact_rgba() 
+ * gives. Batched like generate_artifacts() at every size. Thread-safe.
+ *
+ * pixels - array of count * size * size pixels, filled with one artifact
+ *      after another
+ */
+void generate_artifacts_rgba(uint32_t *pixels, uint32_t first_id, int count,
+    const ArtifactFormat *format, uint32_t alpha_mask);
+
+/* what a lookup of the ids that generate a given 8x8 image checks, 
+ * prepared by prepare_lookup().
+ */
+typedef struct ArtifactLookup {
+    uint32_t pixels[8 * 8]; // the image, like expand_artifact_rgba() gives
+    uint32_t alpha_mask;
+    int version; // of the generator
+    uint8_t possible; // drawn symmetries (PackedArtifact's sym) it can have
+    int checks; // fill draws checked before generating the artifact
+    uint8_t draws[8 * 8]; // index of each, the most telling first
+    uint8_t filled[8 * 8]; // whether its pixel must be filled
+    uint8_t symmetries[8 * 8]; // possible symmetries ruled out if it isn't
+} ArtifactLookup;
+
+/* Prepares a lookup of the ids generating the given 8x8 pixels (with their
+ * drawn symmetry), in the form expand_artifact_rgba() gives them with the 
+ * given alpha mask.
+ *
+ * version - ARTIFACT_V* of the generator
+ */
+void prepare_lookup(ArtifactLookup *lookup, const uint32_t *pixels, 
+    uint32_t alpha_mask, int version);
+
+/* Finds the ids in [first_id, first_id + count) that generate exactly the
+ * looked up pixels. Almost every id is ruled out after a few of its fill 
+ * draws, which are computed straight from the seed (v1 is linear once 
+ * seeded, v2 draws any number directly) instead of after the numbers glibc
+ * discards. The remaining 
+ * ones are generated and compared. Runs ARTIFACT_BATCH_LANES ids at once 
+ * like generate_artifacts(). Thread-safe. Misses the (very few) artifacts
+ * that draw a color of 0, whose pixels of that color are transparent.
+ *
+ * ids - receives the ids found, ascending, up to capacity of them
+ * count - at most 2^32 - first_id
+ * Returns the number of ids found, which may be more than capacity.
+ */
+int lookup_artifacts(const ArtifactLookup *lookup, uint32_t first_id, 
+    uint64_t count, uint32_t *ids, int capacity);
+
 #endif
@@ -0,0 +1,1189 @@
+/* image.c - draws artifacts into images, saves and loads them without SDL
+    author: Andrew Klinge
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "image.h"
+
+// sizes of the BMP file header and the BITMAPV4HEADER that follows it
+#define BMP_FILE_HEADER 14
+#define BMP_INFO_HEADER 108
+// longest match and farthest distance back of a deflate stream
+#define DEFLATE_MAX_MATCH 258
+#define DEFLATE_WINDOW 32768
+#define ADLER_MOD 65521
+// GIF codes are at most 12 bits
+#define GIF_MAX_CODES 4096
+// most pixels of an image that can be loaded
+#define MAX_LOADED_PIXELS (1 << 26)
+
+Image create_image(int width, int height) {
+    Image image = {.width = width, .height = height};
+    image.pixels = calloc((size_t) width * height, sizeof(uint32_t));
+    if (image.pixels == NULL) {
+        fprintf(stderr, "Failed to allocate %dx%d image\n", width, height);
+        exit(EXIT_FAILURE);
+    }
+    return image;
+}
+
+void free_image(Image *image) {
+    free(image->pixels);
+    image->pixels = NULL;
+}
+
+void draw_artifact(Image *image, const PackedArtifact *artifact, int x, int y,
+        int scale) {
+    uint32_t pixels[8 * 8];
+    expand_artifact_rgba(artifact, pixels, IMAGE_ALPHA);
+    draw_pixels(image, pixels, 8, x, y, scale);
+}
+
+void draw_pixels(Image *image, const uint32_t *pixels, int size, int x, int y,
+        int scale) {
+    for (int py = 0; py < size; py++) {
+        // draw one scaled row, then copy it down scale - 1 times
+        uint32_t *row = image->pixels + (size_t) (y + py * scale) * image->width
+            + x;
+        for (int px = 0; px < size; px++) {
+            if (pixels[px + py * size] == 0) continue;
+            for (int i = 0; i < scale; i++) {
+                row[px * scale + i] = pixels[px + py * size];
+            }
+        }
+        for (int i = 1; i < scale; i++) {
+            memcpy(row + (size_t) i * image->width, row, 
+                sizeof(uint32_t) * size * scale);
+        }
+    }
+}
+
+static const char *FORMAT_NAMES[] = {"png", "gif", "bmp"};
+
+// deflate lengths and distances: the first of each code and its extra bits
+static const uint16_t LENGTH_BASES[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 
+    15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 
+    227, 258};
+static const uint8_t LENGTH_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 
+    2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t DISTANCE_BASES[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 
+    33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 
+    4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t DISTANCE_EXTRA[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 
+    4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+/* deflate's fixed Huffman codes, bit-reversed into the order they're 
+ * written in.
+ */
+typedef struct DeflateTables {
+    uint16_t codes[288]; // of each literal/length symbol
+    uint8_t lengths[288]; // in bits
+    uint8_t length_codes[DEFLATE_MAX_MATCH + 1]; // index in LENGTH_BASES
+    uint8_t distance_codes[30]; // all 5 bits
+} DeflateTables;
+
+static DeflateTables deflate_tables;
+static pthread_once_t deflate_once = PTHREAD_ONCE_INIT;
+
+// CRC-32 of each byte, for PNG chunks
+static uint32_t crc_table[256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+/* bits written least significant first into an encoder's data, as both
+ * deflate and GIF pack them. room must have been reserved for them.
+ */
+typedef struct BitWriter {
+    Encoder *encoder;
+    uint64_t bits;
+    int count;
+} BitWriter;
+
+int image_format_by_name(const char *name) {
+    for (int i = 0; i < 3; i++) {
+        if (strcmp(name, FORMAT_NAMES[i]) == 0) return i;
+    }
+    return -1;
+}
+
+const char *image_format_name(int format) {
+    return FORMAT_NAMES[format];
+}
+
+void free_encoder(Encoder *encoder) {
+    free(encoder->data);
+    free(encoder->indices);
+    free(encoder->rows);
+    free(encoder->codes);
+    memset(encoder, 0, sizeof(Encoder));
+}
+
+/* grows the buffer to at least size bytes. returns false if out of memory. */
+static bool grow(uint8_t **buffer, size_t *capacity, size_t size) {
+    if (size <= *capacity) return true;
+    if (size < *capacity * 2) size = *capacity * 2;
+    uint8_t *grown = realloc(*buffer, size);
+    if (grown == NULL) return false;
+    *buffer = grown;
+    *capacity = size;
+    return true;
+}
+
+/* makes room for extra more bytes of data. returns false if out of memory. */
+static bool reserve(Encoder *encoder, size_t extra) {
+    return grow(&encoder->data, &encoder->capacity, encoder->size + extra);
+}
+
+/* adds bytes to the end of the data (reserved), returning where they go. */
+static uint8_t *extend(Encoder *encoder, size_t size) {
+    uint8_t *bytes = encoder->data + encoder->size;
+    encoder->size += size;
+    return bytes;
+}
+
+/* writes little-endian values into a header. */
+static uint8_t *put16(uint8_t *dest, uint16_t value) {
+    dest[0] = value;
+    dest[1] = value >> 8;
+    return dest + 2;
+}
+
+static uint8_t *put32(uint8_t *dest, uint32_t value) {
+    put16(dest, value);
+    return put16(dest + 2, value >> 16);
+}
+
+/* writes big-endian values, as PNG stores them. */
+static uint8_t *put32_be(uint8_t *dest, uint32_t value) {
+    dest[0] = value >> 24;
+    dest[1] = value >> 16;
+    dest[2] = value >> 8;
+    dest[3] = value;
+    return dest + 4;
+}
+
+/* returns the slot of the color in the encoder's hash table of palette 
+ * colors, or the empty slot it would go in.
+ */
+static uint32_t color_slot(const Encoder *encoder, uint32_t color) {
+    uint32_t slot = (color * 2654435761u) % ENCODER_COLOR_SLOTS;
+    while (encoder->color_slots[slot] != 0 
+    && encoder->color_keys[slot] != color) {
+        slot = (slot + 1) % ENCODER_COLOR_SLOTS;
+    }
+    return slot;
+}
+
+/* index_colors() for any number of colors, looked up in a hash table. */
+static void index_many_colors(Encoder *encoder, const Image *image) {
+    const size_t count = (size_t) image->width * image->height;
+    encoder->palette[0] = 0;
+    encoder->colors = 1;
+    uint32_t last = 0;
+    int index = 0;
+    for (size_t i = 0; i < count; i++) {
+        const uint32_t color = image->pixels[i];
+        // runs of the same color are the common case
+        if (color != last) {
+            last = color;
+            if (color == 0) {
+                index = 0;
+            } else {
+                uint32_t slot = color_slot(encoder, color);
+                if (encoder->color_slots[slot] == 0) {
+                    if (encoder->colors == 256) {
+                        encoder->colors++;
+                        break;
+                    }
+                    encoder->color_keys[slot] = color;
+                    encoder->color_slots[slot] = encoder->colors;
+                    encoder->palette[encoder->colors++] = color;
+                }
+                index = encoder->color_slots[slot];
+            }
+        }
+        encoder->indices[i] = index;
+    }
+    // empty the table for the next image, newest first so each is found
+    for (int i = (encoder->colors < 256 ? encoder->colors : 256) - 1; i > 0; 
+            i--) {
+        encoder->color_slots[color_slot(encoder, encoder->palette[i])] = 0;
+    }
+}
+
+/* finds the palette of the image and the palette index of each of its 
+ * pixels, in order of first use. index 0 is always transparent (0). if there
+ * are more than 256 colors, stops with colors past 256 and indices unset. 
+ * returns false if out of memory.
+ */
+static bool index_colors(Encoder *encoder, const Image *image) {
+    const size_t count = (size_t) image->width * image->height;
+    if (!grow(&encoder->indices, &encoder->indices_capacity, count)) {
+        return false;
+    }
+    // up to 4 colors (any single artifact) are told apart without branches,
+    // which the noisy pixels of artifacts would keep mispredicting. unused 
+    // colors are 0, so they're only matched for pixels that aren't
+    const uint32_t *pixels = image->pixels;
+    uint8_t *indices = encoder->indices;
+    uint32_t color1 = 0, color2 = 0, color3 = 0;
+    int colors = 1;
+    for (size_t i = 0; i < count; i++) {
+        const uint32_t color = pixels[i];
+        if ((color != 0) & (color != color1) & (color != color2) 
+        & (color != color3)) {
+            if (colors == 4) {
+                index_many_colors(encoder, image);
+                return true;
+            }
+            if (colors == 1) color1 = color;
+            else if (colors == 2) color2 = color;
+            else color3 = color;
+            colors++;
+        }
+        indices[i] = ((color == color1) | (color == color2) << 1 
+            | (color == color3) * 3) & -(color != 0);
+    }
+    encoder->palette[0] = 0;
+    encoder->palette[1] = color1;
+    encoder->palette[2] = color2;
+    encoder->palette[3] = color3;
+    encoder->colors = colors;
+    return true;
+}
+
+static void build_deflate_tables() {
+    DeflateTables *tables = &deflate_tables;
+    for (int symbol = 0; symbol < 288; symbol++) {
+        int code, length;
+        if (symbol < 144) {
+            code = 0x30 + symbol;
+            length = 8;
+        } else if (symbol < 256) {
+            code = 0x190 + symbol - 144;
+            length = 9;
+        } else if (symbol < 280) {
+            code = symbol - 256;
+            length = 7;
+        } else {
+            code = 0xc0 + symbol - 280;
+            length = 8;
+        }
+        int reversed = 0;
+        for (int i = 0; i < length; i++) {
+            reversed |= (code >> i & 1) << (length - 1 - i);
+        }
+        tables->codes[symbol] = reversed;
+        tables->lengths[symbol] = length;
+    }
+    int code = 0;
+    for (int length = 3; length <= DEFLATE_MAX_MATCH; length++) {
+        while (code < 28 && LENGTH_BASES[code + 1] <= length) code++;
+        tables->length_codes[length] = code;
+    }
+    for (int code = 0; code < 30; code++) {
+        int reversed = 0;
+        for (int i = 0; i < 5; i++) reversed |= (code >> i & 1) << (4 - i);
+        tables->distance_codes[code] = reversed;
+    }
+}
+
+static void put_bits(BitWriter *writer, uint32_t value, int count) {
+    writer->bits |= (uint64_t) value << writer->count;
+    writer->count += count;
+    while (writer->count >= 8) {
+        *extend(writer->encoder, 1) = writer->bits;
+        writer->bits >>= 8;
+        writer->count -= 8;
+    }
+}
+
+/* writes out the last partial byte. */
+static void flush_bits(BitWriter *writer) {
+    if (writer->count > 0) put_bits(writer, 0, 8 - writer->count);
+}
+
+static void put_symbol(BitWriter *writer, int symbol) {
+    put_bits(writer, deflate_tables.codes[symbol], 
+        deflate_tables.lengths[symbol]);
+}
+
+/* writes a copy of the length bytes starting distance bytes back. */
+static void put_match(BitWriter *writer, int length, int distance) {
+    const int code = deflate_tables.length_codes[length];
+    // past 4, each power of 2 of distance - 1 is split in two codes
+    int dist = distance - 1;
+    if (distance > 4) {
+        int bits = 1;
+        while ((distance - 1) >> (bits + 1)) bits++;
+        dist = bits * 2 + ((distance - 1) >> (bits - 1) & 1);
+    }
+    // at most 8 + 5 + 5 + 13 bits, so it's put all at once
+    uint32_t bits = deflate_tables.codes[257 + code];
+    int count = deflate_tables.lengths[257 + code];
+    bits |= (uint32_t) (length - LENGTH_BASES[code]) << count;
+    count += LENGTH_EXTRA[code];
+    bits |= (uint32_t) deflate_tables.distance_codes[dist] << count;
+    count += 5;
+    bits |= (uint32_t) (distance - DISTANCE_BASES[dist]) << count;
+    put_bits(writer, bits, count + DISTANCE_EXTRA[dist]);
+}
+
+/* compresses the second of the two rows of stride bytes at rows, as copies
+ * of the byte before or the row above (if there is one) where they're long
+ * enough. scaling makes both common, and they're all a palette has. after
+ * the rows, rows needs room for stride * 2 more bytes.
+ */
+static void deflate_row(BitWriter *writer, uint8_t *rows, size_t stride, 
+        bool above) {
+    const uint8_t *row = rows + stride;
+    // how many bytes from each on are the same as the one before / above, 
+    // counted backwards without branching (at most 255, a match is 258)
+    uint8_t *same = rows + stride * 2;
+    uint8_t *same_above = same + stride;
+    int run = 0, run_above = 0;
+    for (size_t i = stride; i-- > 0;) {
+        run = (run + 1) & -(row[i] == row[(int64_t) i - 1]);
+        run = run < 255 ? run : 255;
+        same[i] = run;
+        run_above = (run_above + 1) & -(row[i] == rows[i]);
+        run_above = run_above < 255 ? run_above : 255;
+        same_above[i] = run_above;
+    }
+    // the first byte has nothing before it in the first row
+    if (!above) same[0] = 0;
+    above = above && stride <= DEFLATE_WINDOW;
+    size_t i = 0;
+    while (i < stride) {
+        size_t best = same[i], distance = 1;
+        if (above && same_above[i] > best) {
+            best = same_above[i];
+            distance = stride;
+        }
+        if (best >= 3) {
+            put_match(writer, best, distance);
+            i += best;
+        } else {
+            put_symbol(writer, row[i++]);
+        }
+    }
+}
+
+/* compresses count rows the same as the last one (the first of rows). being
+ * periodic, they are all one copy from a row back.
+ */
+static void repeat_rows(BitWriter *writer, size_t stride, int count) {
+    size_t left = stride * count;
+    while (left > 0) {
+        size_t length = left < DEFLATE_MAX_MATCH ? left : DEFLATE_MAX_MATCH;
+        // leave enough for the last match
+        if (left - length > 0 && left - length < 3) length = left - 3;
+        put_match(writer, length, stride);
+        left -= length;
+    }
+}
+
+/* adds count copies of size bytes to an adler-32 checksum (a, b), given 
+ * their sum and their sum weighted by distance from the end (so repeating
+ * them costs the same as adding them once).
+ */
+static void adler_add(uint32_t *a, uint32_t *b, size_t size, uint32_t sum, 
+        uint32_t weighted, uint64_t count) {
+    // each copy adds size * a to b, and sum to a
+    const uint64_t copies = count % ADLER_MOD;
+    const uint64_t pairs = count * (count - 1) / 2 % ADLER_MOD;
+    const uint64_t length = size % ADLER_MOD;
+    *b = (*b + copies * length % ADLER_MOD * *a 
+        + length * sum % ADLER_MOD * pairs + copies * weighted) % ADLER_MOD;
+    *a = (*a + copies * sum) % ADLER_MOD;
+}
+
+/* fills a PNG row of the image: filter type 0, then row y of the image 
+ * scaled up, as palette indices of the given bits or as 8-bit RGBA (32).
+ */
+static void build_row(const Encoder *encoder, const Image *image, int y, 
+        int scale, int bits, uint8_t *row) {
+    *row++ = 0;
+    if (bits == 32) {
+        const uint32_t *src = image->pixels + (size_t) y * image->width;
+        for (int x = 0; x < image->width; x++) {
+            for (int i = 0; i < scale; i++) {
+                row = put32_be(row, src[x] << 24 | (src[x] & 0xff00) << 8 
+                    | (src[x] >> 8 & 0xff00) | src[x] >> 24);
+            }
+        }
+        return;
+    }
+    const uint8_t *src = encoder->indices + (size_t) y * image->width;
+    unsigned packed = 0;
+    int count = 0;
+    for (int x = 0; x < image->width; x++) {
+        for (int i = 0; i < scale; i++) {
+            packed = packed << bits | src[x];
+            count += bits;
+            if (count == 8) {
+                *row++ = packed;
+                packed = 0;
+                count = 0;
+            }
+        }
+    }
+    if (count > 0) *row = packed << (8 - count);
+}
+
+/* begins a PNG chunk of the given type (reserved), returning its offset. */
+static size_t begin_chunk(Encoder *encoder, const char *type) {
+    size_t start = encoder->size;
+    memcpy(extend(encoder, 8) + 4, type, 4);
+    return start;
+}
+
+static void build_crc_table() {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) c = c & 1 ? 0xedb88320 ^ (c >> 1) 
+            : c >> 1;
+        crc_table[i] = c;
+    }
+}
+
+/* finishes the PNG chunk at the given offset (with 4 bytes reserved). */
+static void end_chunk(Encoder *encoder, size_t start) {
+    pthread_once(&crc_once, build_crc_table);
+    const size_t length = encoder->size - start - 8;
+    put32_be(encoder->data + start, length);
+    uint32_t crc = ~0u;
+    for (size_t i = start + 4; i < encoder->size; i++) {
+        crc = crc_table[(crc ^ encoder->data[i]) & 0xff] ^ (crc >> 8);
+    }
+    put32_be(extend(encoder, 4), ~crc);
+}
+
+static int encode_png(Encoder *encoder, const Image *image, int scale) {
+    pthread_once(&deflate_once, build_deflate_tables);
+    const int colors = encoder->colors;
+    int bits = 32;
+    if (colors <= 256) {
+        bits = 1;
+        while (1 << bits < colors) bits *= 2;
+    }
+    const size_t width = (size_t) image->width * scale;
+    const size_t stride = 1 + (width * bits + 7) / 8;
+    encoder->size = 0;
+    if (!grow(&encoder->rows, &encoder->rows_capacity, stride * 4)
+    || !reserve(encoder, 1024)) {
+        return -1;
+    }
+    static const uint8_t SIGNATURE[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 
+        0x1a, '\n'};
+    memcpy(extend(encoder, 8), SIGNATURE, 8);
+    size_t chunk = begin_chunk(encoder, "IHDR");
+    uint8_t *header = extend(encoder, 13);
+    header = put32_be(header, width);
+    header = put32_be(header, image->height * scale);
+    header[0] = bits == 32 ? 8 : bits; // bit depth
+    header[1] = bits == 32 ? 6 : 3; // RGBA or palette
+    header[2] = header[3] = header[4] = 0; // deflate, no filter, no interlace
+    end_chunk(encoder, chunk);
+    if (bits < 32) {
+        chunk = begin_chunk(encoder, "PLTE");
+        uint8_t *palette = extend(encoder, colors * 3);
+        int last_alpha = 0; // last color that isn't opaque
+        for (int i = 0; i < colors; i++) {
+            *palette++ = encoder->palette[i];
+            *palette++ = encoder->palette[i] >> 8;
+            *palette++ = encoder->palette[i] >> 16;
+            if (encoder->palette[i] >> 24 != 0xff) last_alpha = i;
+        }
+        end_chunk(encoder, chunk);
+        chunk = begin_chunk(encoder, "tRNS");
+        uint8_t *alpha = extend(encoder, last_alpha + 1);
+        for (int i = 0; i <= last_alpha; i++) {
+            alpha[i] = encoder->palette[i] >> 24;
+        }
+        end_chunk(encoder, chunk);
+    }
+
+    // image data: a zlib stream of one block of fixed Huffman codes
+    chunk = begin_chunk(encoder, "IDAT");
+    uint8_t *zlib = extend(encoder, 2);
+    zlib[0] = 0x78; // deflate, 32K window
+    zlib[1] = 0x01; // no preset dictionary (checksum of 31)
+    BitWriter writer = {.encoder = encoder};
+    put_bits(&writer, 1, 1); // BFINAL
+    put_bits(&writer, 1, 2); // BTYPE 01, fixed codes
+    uint32_t a = 1, b = 0; // adler-32
+    uint8_t *row = encoder->rows + stride;
+    for (int y = 0; y < image->height; y++) {
+        build_row(encoder, image, y, scale, bits, row);
+        uint64_t sum = 0, weighted = 0;
+        for (size_t i = 0; i < stride; i++) {
+            sum += row[i];
+            weighted += (stride - i) * row[i];
+        }
+        sum %= ADLER_MOD;
+        weighted %= ADLER_MOD;
+        // a literal is at most 9 bits
+        if (!reserve(encoder, stride * 2 + 64)) return -1;
+        deflate_row(&writer, encoder->rows, stride, y > 0);
+        memcpy(encoder->rows, row, stride);
+        if (stride >= 3 && stride <= DEFLATE_WINDOW) {
+            // a match is at most 31 bits, and all but the last 2 are longest
+            if (!reserve(encoder, stride * (scale - 1) / DEFLATE_MAX_MATCH * 4
+                + 64)) {
+                return -1;
+            }
+            repeat_rows(&writer, stride, scale - 1);
+        } else {
+            for (int i = 1; i < scale; i++) {
+                if (!reserve(encoder, stride * 2 + 64)) return -1;
+                deflate_row(&writer, encoder->rows, stride, true);
+            }
+        }
+        adler_add(&a, &b, stride, sum, weighted, scale);
+    }
+    if (!reserve(encoder, 64)) return -1;
+    put_symbol(&writer, 256); // end of block
+    flush_bits(&writer);
+    put32_be(extend(encoder, 4), b << 16 | a);
+    end_chunk(encoder, chunk);
+    chunk = begin_chunk(encoder, "IEND");
+    end_chunk(encoder, chunk);
+    return 0;
+}
+
+/* empties the GIF code table: the rows of the codes of single indices. the
+ * rows of longer codes are emptied as they are added.
+ */
+static void clear_codes(uint16_t *codes, int min_bits) {
+    memset(codes, 0, sizeof(uint16_t) << min_bits * 2);
+}
+
+static int encode_gif(Encoder *encoder, const Image *image, int scale) {
+    const size_t width = (size_t) image->width * scale;
+    const size_t height = (size_t) image->height * scale;
+    if (encoder->colors > 256 || width > UINT16_MAX || height > UINT16_MAX) {
+        errno = EOVERFLOW;
+        return -1;
+    }
+    int bits = 1;
+    while (1 << bits < encoder->colors) bits++;
+    encoder->size = 0;
+    if (!reserve(encoder, 1024)) return -1;
+    uint8_t *header = extend(encoder, 13 + 3 * (1 << bits) + 8 + 10 + 1);
+    memcpy(header, "GIF89a", 6);
+    header = put16(header + 6, width);
+    header = put16(header, height);
+    *header++ = 0x80 | (bits - 1) << 4 | (bits - 1); // global color table
+    *header++ = 0; // background color
+    *header++ = 0; // no aspect ratio
+    for (int i = 0; i < 1 << bits; i++) {
+        uint32_t color = i < encoder->colors ? encoder->palette[i] : 0;
+        *header++ = color;
+        *header++ = color >> 8;
+        *header++ = color >> 16;
+    }
+    // graphic control extension, making color 0 transparent
+    static const uint8_t CONTROL[8] = {0x21, 0xf9, 4, 1, 0, 0, 0, 0};
+    memcpy(header, CONTROL, 8);
+    header += 8;
+    // image descriptor, covering the whole screen
+    *header++ = 0x2c;
+    header = put16(header, 0);
+    header = put16(header, 0);
+    header = put16(header, width);
+    header = put16(header, height);
+    *header++ = 0; // no local color table, not interlaced
+    const int min_bits = bits < 2 ? 2 : bits;
+    *header = min_bits;
+    // for each code, the codes of it followed by each index (0 for none)
+    if (!grow(&encoder->codes, &encoder->codes_capacity,
+            sizeof(uint16_t) * GIF_MAX_CODES << min_bits)) {
+        return -1;
+    }
+    uint16_t *codes = (uint16_t*) encoder->codes;
+
+    // LZW compressed indices, packed like deflate and split into blocks after
+    const size_t start = encoder->size;
+    const int clear = 1 << min_bits;
+    int next = clear + 2; // next code to add
+    int code_bits = min_bits + 1;
+    BitWriter writer = {.encoder = encoder};
+    clear_codes(codes, min_bits);
+    put_bits(&writer, clear, code_bits);
+    int prefix = -1; // code of the indices so far
+    for (int y = 0; y < image->height; y++) {
+        const uint8_t *src = encoder->indices + (size_t) y * image->width;
+        for (int i = 0; i < scale; i++) {
+            // a code is at most 12 bits for each pixel
+            if (!reserve(encoder, width * 2 + 16)) return -1;
+            for (int x = 0; x < image->width; x++) {
+                for (int j = 0; j < scale; j++) {
+                    if (prefix < 0) {
+                        prefix = src[x];
+                        continue;
+                    }
+                    uint16_t *child = codes + (prefix << min_bits | src[x]);
+                    if (*child != 0) {
+                        prefix = *child;
+                        continue;
+                    }
+                    put_bits(&writer, prefix, code_bits);
+                    if (next < GIF_MAX_CODES) {
+                        *child = next;
+                        memset(codes + (next << min_bits), 0, 
+                            sizeof(uint16_t) << min_bits);
+                        // the decoder widens its codes once it has this one
+                        if (next == 1 << code_bits) code_bits++;
+                        next++;
+                    } else {
+                        put_bits(&writer, clear, code_bits);
+                        clear_codes(codes, min_bits);
+                        next = clear + 2;
+                        code_bits = min_bits + 1;
+                    }
+                    prefix = src[x];
+                }
+            }
+        }
+    }
+    if (!reserve(encoder, 16)) return -1;
+    put_bits(&writer, prefix, code_bits);
+    put_bits(&writer, clear + 1, code_bits); // end of information
+    flush_bits(&writer);
+    // split into blocks of 255 bytes, each after its size, from the end
+    const size_t size = encoder->size - start;
+    const size_t blocks = (size + 254) / 255;
+    if (!reserve(encoder, blocks + 2)) return -1;
+    for (size_t i = blocks; i-- > 0;) {
+        const size_t length = i == blocks - 1 ? size - i * 255 : 255;
+        uint8_t *block = encoder->data + start + i * 256;
+        memmove(block + 1, encoder->data + start + i * 255, length);
+        block[0] = length;
+    }
+    encoder->size = start + size + blocks;
+    uint8_t *end = extend(encoder, 2);
+    end[0] = 0; // no more blocks
+    end[1] = 0x3b; // trailer
+    return 0;
+}
+
+static int encode_bmp(Encoder *encoder, const Image *image, int scale) {
+    const size_t width = (size_t) image->width * scale;
+    const size_t height = (size_t) image->height * scale;
+    const size_t row_size = width * 4;
+    const uint32_t offset = BMP_FILE_HEADER + BMP_INFO_HEADER;
+    if (offset + row_size * height > UINT32_MAX) {
+        errno = EOVERFLOW;
+        return -1;
+    }
+    encoder->size = 0;
+    if (!reserve(encoder, offset + row_size * height)) return -1;
+    uint8_t *header = extend(encoder, offset);
+    memset(header, 0, offset);
+    // file header
+    header[0] = 'B';
+    header[1] = 'M';
+    put32(header + 2, offset + row_size * height);
+    put32(header + 10, offset);
+    // info header (BITMAPV4HEADER, BI_BITFIELDS so alpha is kept)
+    uint8_t *info = header + BMP_FILE_HEADER;
+    put32(info, BMP_INFO_HEADER);
+    put32(info + 4, width);
+    put32(info + 8, height);
+    put16(info + 12, 1); // planes
+    put16(info + 14, 32); // bits per pixel
+    put32(info + 16, 3); // BI_BITFIELDS
+    put32(info + 20, row_size * height);
+    put32(info + 24, 2835); // 72 DPI
+    put32(info + 28, 2835);
+    put32(info + 40, 0x00ff0000); // red mask
+    put32(info + 44, 0x0000ff00); // green mask
+    put32(info + 48, 0x000000ff); // blue mask
+    put32(info + 52, 0xff000000); // alpha mask
+    put32(info + 56, 0x73524742); // 'sRGB'
+
+    // rows are stored bottom-up, pixels as B, G, R, A
+    for (int y = image->height - 1; y >= 0; y--) {
+        const uint32_t *src = image->pixels + (size_t) y * image->width;
+        uint8_t *row = extend(encoder, row_size);
+        for (int x = 0; x < image->width; x++) {
+            uint32_t bgra = (src[x] & 0xff00ff00) | (src[x] & 0xff) << 16 
+                | (src[x] >> 16 & 0xff);
+            for (int i = 0; i < scale; i++) {
+                put32(row + (x * scale + i) * 4, bgra);
+            }
+        }
+        for (int i = 1; i < scale; i++) {
+            memcpy(extend(encoder, row_size), row, row_size);
+        }
+    }
+    return 0;
+}
+
+int encode_image(Encoder *encoder, const Image *image, int scale, 
+        int format) {
+    if ((uint64_t) image->width * scale > INT32_MAX 
+    || (uint64_t) image->height * scale > INT32_MAX) {
+        errno = EOVERFLOW;
+        return -1;
+    }
+    if (format == IMAGE_BMP) return encode_bmp(encoder, image, scale);
+    if (!index_colors(encoder, image)) return -1;
+    if (format == IMAGE_GIF) return encode_gif(encoder, image, scale);
+    return encode_png(encoder, image, scale);
+}
+
+int save_encoded(const Encoder *encoder, const char *path) {
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) return -1;
+    int result = fwrite(encoder->data, encoder->size, 1, file) == 1 ? 0 : -1;
+    if (fclose(file) != 0) result = -1;
+    return result;
+}
+
+static uint32_t get16(const uint8_t *src) {
+    return src[0] | src[1] << 8;
+}
+
+static uint32_t get32(const uint8_t *src) {
+    return src[0] | src[1] << 8 | src[2] << 16 | (uint32_t) src[3] << 24;
+}
+
+static uint32_t get32_be(const uint8_t *src) {
+    return (uint32_t) src[0] << 24 | src[1] << 16 | src[2] << 8 | src[3];
+}
+
+/* bits read least significant first, like a BitWriter writes them. reading
+ * past the end gives zeros and sets overrun.
+ */
+typedef struct BitReader {
+    const uint8_t *data;
+    size_t size;
+    size_t position; // of the next byte
+    uint64_t bits;
+    int count;
+    bool overrun;
+} BitReader;
+
+static uint32_t get_bits(BitReader *reader, int count) {
+    while (reader->count < count) {
+        if (reader->position < reader->size) {
+            reader->bits |= (uint64_t) reader->data[reader->position++] 
+                << reader->count;
+        } else {
+            reader->overrun = true;
+        }
+        reader->count += 8;
+    }
+    uint32_t value = reader->bits & ((1ull << count) - 1);
+    reader->bits >>= count;
+    reader->count -= count;
+    return value;
+}
+
+/* a canonical Huffman code, decoded a bit at a time (images loaded are 
+ * small).
+ */
+typedef struct Huffman {
+    uint16_t counts[16]; // codes of each length
+    uint16_t symbols[288]; // ordered by code
+} Huffman;
+
+/* builds the code with the given length of each symbol (0 for unused). 
+ * returns false if there are too many codes of some length.
+ */
+static bool build_huffman(Huffman *huffman, const uint8_t *lengths, 
+        int symbols) {
+    memset(huffman->counts, 0, sizeof(huffman->counts));
+    for (int i = 0; i < symbols; i++) huffman->counts[lengths[i]]++;
+    int left = 1;
+    uint16_t offsets[16] = {0};
+    for (int length = 1; length < 16; length++) {
+        left = left * 2 - huffman->counts[length];
+        if (left < 0) return false;
+        if (length < 15) {
+            offsets[length + 1] = offsets[length] + huffman->counts[length];
+        }
+    }
+    for (int i = 0; i < symbols; i++) {
+        if (lengths[i] != 0) huffman->symbols[offsets[lengths[i]]++] = i;
+    }
+    return true;
+}
+
+/* returns the next symbol, or -1 if the code is invalid. */
+static int get_symbol(BitReader *reader, const Huffman *huffman) {
+    int code = 0; // read so far
+    int first = 0; // first code of the length
+    int index = 0; // of the first symbol of the length
+    for (int length = 1; length < 16; length++) {
+        code |= get_bits(reader, 1);
+        const int count = huffman->counts[length];
+        if (code - first < count) return huffman->symbols[index + code - first];
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+/* decompresses the zlib stream into exactly size bytes at out. returns false
+ * if it's invalid or doesn't have that many.
+ */
+static bool inflate_zlib(const uint8_t *data, size_t data_size, uint8_t *out, 
+        size_t size) {
+    pthread_once(&deflate_once, build_deflate_tables);
+    if (data_size < 2 || (data[0] & 0x0f) != 8 || (data[1] & 0x20) 
+    || (data[0] << 8 | data[1]) % 31 != 0) {
+        return false;
+    }
+    BitReader reader = {.data = data + 2, .size = data_size - 2};
+    size_t position = 0;
+    Huffman literals, distances;
+    uint8_t lengths[288 + 32];
+    bool last = false;
+    while (!last) {
+        last = get_bits(&reader, 1);
+        const int type = get_bits(&reader, 2);
+        if (type == 0) { // stored
+            get_bits(&reader, reader.count & 7);
+            const uint32_t length = get_bits(&reader, 16);
+            if ((get_bits(&reader, 16) ^ length) != 0xffff 
+            || length > size - position) {
+                return false;
+            }
+            for (uint32_t i = 0; i < length; i++) {
+                out[position++] = get_bits(&reader, 8);
+            }
+            if (reader.overrun) return false;
+            continue;
+        }
+        if (type == 1) {
+            for (int i = 0; i < 288; i++) {
+                lengths[i] = deflate_tables.lengths[i];
+            }
+            for (int i = 0; i < 30; i++) lengths[288 + i] = 5;
+            build_huffman(&literals, lengths, 288);
+            build_huffman(&distances, lengths + 288, 30);
+        } else if (type == 2) {
+            static const uint8_t ORDER[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 
+                5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+            const int literal_count = get_bits(&reader, 5) + 257;
+            const int distance_count = get_bits(&reader, 5) + 1;
+            const int length_count = get_bits(&reader, 4) + 4;
+            uint8_t length_lengths[19] = {0};
+            for (int i = 0; i < length_count; i++) {
+                length_lengths[ORDER[i]] = get_bits(&reader, 3);
+            }
+            Huffman code_lengths;
+            if (literal_count > 286 || distance_count > 30 
+            || !build_huffman(&code_lengths, length_lengths, 19)) {
+                return false;
+            }
+            int i = 0;
+            while (i < literal_count + distance_count) {
+                int symbol = get_symbol(&reader, &code_lengths);
+                if (symbol < 0 || reader.overrun) return false;
+                if (symbol < 16) {
+                    lengths[i++] = symbol;
+                    continue;
+                }
+                int repeat, value = 0;
+                if (symbol == 16) {
+                    if (i == 0) return false;
+                    value = lengths[i - 1];
+                    repeat = 3 + get_bits(&reader, 2);
+                } else if (symbol == 17) {
+                    repeat = 3 + get_bits(&reader, 3);
+                } else {
+                    repeat = 11 + get_bits(&reader, 7);
+                }
+                if (i + repeat > literal_count + distance_count) return false;
+                while (repeat-- > 0) lengths[i++] = value;
+            }
+            if (!build_huffman(&literals, lengths, literal_count)
+            || !build_huffman(&distances, lengths + literal_count, 
+                distance_count)) {
+                return false;
+            }
+        } else {
+            return false;
+        }
+        while (true) {
+            const int symbol = get_symbol(&reader, &literals);
+            if (symbol < 0 || reader.overrun) return false;
+            if (symbol < 256) {
+                if (position == size) return false;
+                out[position++] = symbol;
+                continue;
+            }
+            if (symbol == 256) break;
+            const int code = symbol - 257;
+            if (code >= 29) return false;
+            const size_t length = LENGTH_BASES[code] 
+                + get_bits(&reader, LENGTH_EXTRA[code]);
+            const int dist = get_symbol(&reader, &distances);
+            if (dist < 0 || dist >= 30) return false;
+            const size_t distance = DISTANCE_BASES[dist] 
+                + get_bits(&reader, DISTANCE_EXTRA[dist]);
+            if (distance > position || length > size - position) return false;
+            for (size_t i = 0; i < length; i++, position++) {
+                out[position] = out[position - distance];
+            }
+        }
+    }
+    return position == size && !reader.overrun;
+}
+
+/* the Paeth predictor of PNG's filter type 4. */
+static int paeth(int left, int up, int up_left) {
+    const int p = left + up - up_left;
+    const int pa = abs(p - left), pb = abs(p - up), pc = abs(p - up_left);
+    if (pa <= pb && pa <= pc) return left;
+    return pb <= pc ? up : up_left;
+}
+
+/* decodes a PNG (any but interlaced ones). returns false if it can't. */
+static bool load_png(Image *image, const uint8_t *data, size_t size) {
+    int width = 0, height = 0, depth = 0, color_type = -1;
+    uint32_t palette[256] = {0};
+    int transparent = -1; // gray or RGB(16 bits each) color of tRNS
+    uint64_t transparent_rgb = 0;
+    uint8_t *compressed = NULL;
+    size_t compressed_size = 0;
+    size_t position = 8;
+    while (position + 12 <= size) {
+        const uint32_t length = get32_be(data + position);
+        const uint8_t *type = data + position + 4;
+        const uint8_t *chunk = data + position + 8;
+        if (length > size - position - 12) break;
+        position += length + 12;
+        if (memcmp(type, "IHDR", 4) == 0 && length >= 13) {
+            width = get32_be(chunk);
+            height = get32_be(chunk + 4);
+            depth = chunk[8];
+            color_type = chunk[9];
+            if (chunk[12] != 0) break; // interlaced
+        } else if (memcmp(type, "PLTE", 4) == 0) {
+            for (uint32_t i = 0; i < length / 3 && i < 256; i++) {
+                palette[i] = IMAGE_ALPHA | chunk[i * 3] 
+                    | chunk[i * 3 + 1] << 8 | chunk[i * 3 + 2] << 16;
+            }
+        } else if (memcmp(type, "tRNS", 4) == 0) {
+            if (color_type == 3) {
+                for (uint32_t i = 0; i < length && i < 256; i++) {
+                    palette[i] = (palette[i] & ~IMAGE_ALPHA) 
+                        | (uint32_t) chunk[i] << 24;
+                }
+            } else if (color_type == 0 && length >= 2) {
+                transparent = chunk[0] << 8 | chunk[1];
+            } else if (color_type == 2 && length >= 6) {
+                transparent = 0;
+                for (int i = 0; i < 3; i++) {
+                    transparent_rgb |= (uint64_t) (chunk[i * 2] << 8 
+                        | chunk[i * 2 + 1]) << (i * 16);
+                }
+            }
+        } else if (memcmp(type, "IDAT", 4) == 0) {
+            uint8_t *grown = realloc(compressed, compressed_size + length);
+            if (grown == NULL) break;
+            compressed = grown;
+            memcpy(compressed + compressed_size, chunk, length);
+            compressed_size += length;
+        } else if (memcmp(type, "IEND", 4) == 0) {
+            break;
+        }
+    }
+
+    // bit depths each color type can have
+    static const int DEPTHS[7] = {1 | 2 | 4 | 8 | 16, 0, 8 | 16, 1 | 2 | 4 | 8,
+        8 | 16, 0, 8 | 16};
+    static const int CHANNELS[7] = {1, 0, 3, 1, 2, 0, 4};
+    if (color_type < 0 || color_type > 6 || !(DEPTHS[color_type] & depth)
+    || (depth & (depth - 1)) != 0 || width <= 0 || height <= 0 
+    || (uint64_t) width * height > MAX_LOADED_PIXELS) {
+        free(compressed);
+        return false;
+    }
+    const int channels = CHANNELS[color_type];
+    const size_t stride = ((size_t) width * channels * depth + 7) / 8;
+    const int pixel_bytes = channels * depth < 8 ? 1 : channels * depth / 8;
+    uint8_t *rows = malloc((stride + 1) * height + stride);
+    bool valid = rows != NULL && inflate_zlib(compressed, compressed_size, 
+        rows + stride, (stride + 1) * height);
+    free(compressed);
+    if (!valid) {
+        free(rows);
+        return false;
+    }
+
+    // unfilter each row in place (after its filter type) and convert it
+    *image = create_image(width, height);
+    uint8_t *above = rows; // zeros above the first row
+    memset(above, 0, stride);
+    for (int y = 0; y < height; y++) {
+        uint8_t *row = rows + stride + (stride + 1) * y + 1;
+        const int filter = row[-1];
+        for (size_t i = 0; i < stride; i++) {
+            const int left = i >= (size_t) pixel_bytes ? row[i - pixel_bytes] 
+                : 0;
+            const int up_left = i >= (size_t) pixel_bytes 
+                ? above[i - pixel_bytes] : 0;
+            switch (filter) {
+                case 0: break;
+                case 1: row[i] += left; break;
+                case 2: row[i] += above[i]; break;
+                case 3: row[i] += (left + above[i]) / 2; break;
+                case 4: row[i] += paeth(left, above[i], up_left); break;
+                default: valid = false; break;
+            }
+        }
+        above = row;
+        uint32_t *dest = image->pixels + (size_t) y * width;
+        for (int x = 0; x < width; x++) {
+            // samples of the pixel, scaled to 16 bits
+            int samples[4];
+            for (int c = 0; c < channels; c++) {
+                const size_t bit = ((size_t) x * channels + c) * depth;
+                if (depth == 16) {
+                    samples[c] = row[bit / 8] << 8 | row[bit / 8 + 1];
+                } else {
+                    samples[c] = row[bit / 8] >> (8 - depth - bit % 8) 
+                        & ((1 << depth) - 1);
+                }
+            }
+            if (color_type == 3) {
+                dest[x] = palette[samples[0]];
+                continue;
+            }
+            const bool keyed = transparent >= 0 && (color_type == 0 
+                ? samples[0] == transparent 
+                : ((uint64_t) samples[0] | (uint64_t) samples[1] << 16 
+                    | (uint64_t) samples[2] << 32) == transparent_rgb);
+            const int max = (1 << depth) - 1;
+            for (int c = 0; c < channels; c++) {
+                samples[c] = samples[c] * 255 / max;
+            }
+            uint32_t alpha = IMAGE_ALPHA;
+            if (color_type == 4 || color_type == 6) {
+                alpha = (uint32_t) samples[channels - 1] << 24;
+            }
+            if (keyed) alpha = 0;
+            if (color_type == 0 || color_type == 4) {
+                dest[x] = alpha | samples[0] * 0x010101;
+            } else {
+                dest[x] = alpha | samples[0] | samples[1] << 8 
+                    | samples[2] << 16;
+            }
+        }
+    }
+    free(rows);
+    if (!valid) free_image(image);
+    return valid;
+}
+
+/* returns the lowest bit set in the mask, and its value there in bits. */
+static int mask_shift(uint32_t mask, uint32_t *max) {
+    int shift = 0;
+    while (shift < 32 && !(mask >> shift & 1)) shift++;
+    *max = shift < 32 ? mask >> shift : 0;
+    return shift;
+}
+
+/* decodes an uncompressed 24 or 32-bit BMP. returns false if it can't. */
+static bool load_bmp(Image *image, const uint8_t *data, size_t size) {
+    if (size < BMP_FILE_HEADER + 40) return false;
+    const uint8_t *info = data + BMP_FILE_HEADER;
+    const uint32_t offset = get32(data + 10);
+    const uint32_t header_size = get32(info);
+    const int32_t width = get32(info + 4);
+    const int32_t signed_height = get32(info + 8);
+    const int bits = get16(info + 14);
+    const uint32_t compression = get32(info + 16);
+    const int64_t height = signed_height < 0 ? -(int64_t) signed_height 
+        : signed_height;
+    if (width <= 0 || height <= 0 || (bits != 24 && bits != 32)
+    || (uint64_t) width * height > MAX_LOADED_PIXELS
+    || header_size > size - BMP_FILE_HEADER) {
+        return false;
+    }
+    // red, green, blue and alpha masks
+    uint32_t masks[4] = {0x00ff0000, 0x0000ff00, 0x000000ff, 0};
+    if (compression == 3) { // BI_BITFIELDS, in or after the header
+        const uint8_t *fields = info + 40;
+        if (fields + 16 > data + size || bits != 32) return false;
+        for (int i = 0; i < 3; i++) masks[i] = get32(fields + i * 4);
+        if (header_size >= 56) masks[3] = get32(fields + 12);
+    } else if (compression != 0) {
+        return false;
+    }
+    const size_t row_size = ((size_t) width * bits / 8 + 3) / 4 * 4;
+    if (offset > size || row_size * height > size - offset) return false;
+
+    *image = create_image(width, height);
+    int shifts[4];
+    uint32_t maxes[4];
+    for (int i = 0; i < 4; i++) shifts[i] = mask_shift(masks[i], &maxes[i]);
+    for (int y = 0; y < height; y++) {
+        // rows are bottom-up unless the height is negative
+        const int source = signed_height < 0 ? y : height - 1 - y;
+        const uint8_t *row = data + offset + row_size * source;
+        uint32_t *dest = image->pixels + (size_t) y * width;
+        for (int x = 0; x < width; x++) {
+            const uint32_t value = bits == 32 ? get32(row + x * 4) 
+                : (uint32_t) row[x * 3] | row[x * 3 + 1] << 8 
+                    | row[x * 3 + 2] << 16;
+            uint32_t color = 0;
+            for (int i = 0; i < 4; i++) {
+                uint32_t c = 255;
+                if (maxes[i] != 0) {
+                    c = (value & masks[i]) >> shifts[i];
+                    if (maxes[i] != 255) c = c * 255 / maxes[i];
+                }
+                color |= c << (i * 8);
+            }
+            dest[x] = color;
+        }
+    }
+    return true;
+}
+
+int load_image(Image *image, const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) return -1;
+    uint8_t *data = NULL;
+    size_t size = 0, capacity = 0;
+    while (!feof(file) && !ferror(file)) {
+        if (!grow(&data, &capacity, size + 65536)) {
+            fclose(file);
+            free(data);
+            errno = ENOMEM;
+            return -1;
+        }
+        size += fread(data + size, 1, capacity - size, file);
+    }
+    const bool failed = ferror(file);
+    fclose(file);
+    bool loaded = false;
+    if (!failed && size >= 8 
+    && memcmp(data, "\x89PNG\r\n\x1a\n", 8) == 0) {
+        loaded = load_png(image, data, size);
+    } else if (!failed && size >= 2 && data[0] == 'B' && data[1] == 'M') {
+        loaded = load_bmp(image, data, size);
+    }
+    free(data);
+    if (failed) {
+        errno = EIO;
+        return -1;
+    }
+    if (!loaded) {
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
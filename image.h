@@ -0,0 +1,112 @@
+/* image.c - draws artifacts into images, saves and loads them without SDL
+    author: Andrew Klinge
+*/
+
+#ifndef _IMAGE_H_
+#define _IMAGE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "generator.h"
+
+/* alpha mask of opaque pixels in an Image. */
+#define IMAGE_ALPHA 0xff000000u
+
+/* 32-bit RGBA image. pixels hold red in the lowest byte and alpha in the
+ * highest, like the browser's surfaces on little-endian machines.
+ */
+typedef struct Image {
+    int width;
+    int height;
+    uint32_t *pixels;
+} Image;
+
+/* allocates a fully transparent image. exits if out of memory. */
+Image create_image(int width, int height);
+
+/* frees the pixels of the image. */
+void free_image(Image *image);
+
+/* draws the artifact with its top-left corner at (x, y), scaled up by the
+ * given factor (nearest neighbour). transparent pixels are left untouched.
+ */
+void draw_artifact(Image *image, const PackedArtifact *artifact, int x, int y,
+    int scale);
+
+/* like draw_artifact(), for size x size RGBA pixels (e.g. from 
+ * generate_artifacts_rgba()) with IMAGE_ALPHA as the alpha mask.
+ */
+void draw_pixels(Image *image, const uint32_t *pixels, int size, int x, int y,
+    int scale);
+
+/* file formats images can be encoded in. */
+enum {
+    IMAGE_PNG, // palette-indexed (or 8-bit RGBA past 256 colors)
+    IMAGE_GIF, // palette-indexed, up to 256 colors
+    IMAGE_BMP // 32-bit with alpha
+};
+
+/* returns the IMAGE_* format of the given name or file extension ("png", 
+ * "gif" or "bmp"), or -1 if there is none.
+ */
+int image_format_by_name(const char *name);
+
+/* returns the name (and file extension) of an IMAGE_* format. */
+const char *image_format_name(int format);
+
+/* size of the hash table an Encoder looks up palette colors in. */
+#define ENCODER_COLOR_SLOTS 1024
+
+/* buffers of an image encoder. they are kept from one image to the next, so
+ * once they have grown encoding doesn't allocate. each thread needs its own.
+ * zero-initialize it before the first use and call free_encoder() after the
+ * last.
+ */
+typedef struct Encoder {
+    uint8_t *data; // the last encoded file
+    size_t size; // bytes in data
+    size_t capacity; // bytes allocated for data
+    // internal
+    uint32_t palette[256];
+    int colors; // in the palette, or more than 256 if it didn't fit
+    uint32_t color_keys[ENCODER_COLOR_SLOTS];
+    uint16_t color_slots[ENCODER_COLOR_SLOTS]; // palette index, 0 for none
+    uint8_t *indices; // palette index of each pixel (before scaling)
+    size_t indices_capacity;
+    uint8_t *rows; // the last two scaled rows of a PNG being compressed, and
+        // match lengths in the second
+    size_t rows_capacity;
+    uint8_t *codes; // GIF code table
+    size_t codes_capacity;
+} Encoder;
+
+/* frees the buffers of the encoder. */
+void free_encoder(Encoder *encoder);
+
+/* Encodes the image into encoder->data, scaled up by the given factor 
+ * (nearest neighbour) as it goes, so the scaled image is never allocated.
+ * Returns 0 on success, -1 on failure (errno is set: ENOMEM, or EOVERFLOW if
+ * the image can't be stored in the format).
+ *
+ * PNGs are palette-indexed with as few bits per pixel as the colors need (2
+ * for a single artifact) and compressed for the repeats scaling makes. GIFs 
+ * are the same with up to 256 colors, where fully transparent pixels (0) are
+ * the transparent color.
+ *
+ * format - IMAGE_PNG, IMAGE_GIF or IMAGE_BMP
+ */
+int encode_image(Encoder *encoder, const Image *image, int scale, int format);
+
+/* saves the last image the encoder encoded. returns 0 on success, -1 on 
+ * failure (errno is set).
+ */
+int save_encoded(const Encoder *encoder, const char *path);
+
+/* Loads a PNG (not interlaced) or an uncompressed 24 or 32-bit BMP into a 
+ * new image, to be freed with free_image(). Returns 0 on success, -1 on 
+ * failure (errno is set, EINVAL if it isn't an image that can be loaded).
+ */
+int load_image(Image *image, const char *path);
+
+#endif
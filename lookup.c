@@ -0,0 +1,195 @@
+/* lookup.c - finds the ids that generate a given image of an artifact
+    author: Andrew Klinge
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "commands.h"
+#include "generator.h"
+#include "image.h"
+#include "parallel.h"
+
+// ids handed to a worker at once
+#define BLOCK_SIZE (1 << 20)
+// ids found in a block without allocating (an image has very few)
+#define BLOCK_MATCHES 64
+// seconds between progress reports
+#define REPORT_INTERVAL 10
+
+static const char *USAGE =
+    "usage: artifactor lookup [options] IMAGE [FIRST LAST]\n"
+    "Prints the ids of the artifacts that look exactly like IMAGE, one per\n"
+    "line, searching FIRST to LAST (inclusive, default: all ids). IMAGE is a\n"
+    "PNG or BMP of one 8x8 artifact, at any whole scale. Exits with 1 if\n"
+    "none is found.\n"
+    "  -j THREADS   worker threads (default: number of cores)\n"
+    "  -v VERSION   generator: v1 (default) or v2\n";
+
+typedef struct Search {
+    ArtifactLookup lookup;
+    uint32_t first; // first id of the search
+    uint64_t count; // ids in the search
+
+    pthread_mutex_t lock; // guards everything below
+    uint32_t *ids; // found so far
+    uint64_t found;
+    uint64_t capacity;
+    uint64_t searched;
+    double start_time;
+    double last_report;
+} Search;
+
+/* prints progress. */
+static void report(const Search *search) {
+    double elapsed = seconds() - search->start_time;
+    fprintf(stderr, "%llu/%llu ids (%.1f%%), %llu found, %.0f ids/s\n",
+        (unsigned long long) search->searched,
+        (unsigned long long) search->count,
+        100.0 * search->searched / search->count,
+        (unsigned long long) search->found, search->searched / elapsed);
+}
+
+/* searches ids [first + start, first + start + count). */
+static void search_ids(void *ctx, uint64_t start, uint64_t count,
+        int worker) {
+    Search *search = ctx;
+    const uint32_t first = search->first + start;
+    uint32_t block[BLOCK_MATCHES];
+    uint32_t *ids = block;
+    int found = lookup_artifacts(&search->lookup, first, count, ids,
+        BLOCK_MATCHES);
+    if (found > BLOCK_MATCHES) {
+        // look again with room for all of them
+        ids = malloc(sizeof(uint32_t) * found);
+        if (ids == NULL) {
+            fprintf(stderr, "Failed to allocate %d ids\n", found);
+            exit(EXIT_FAILURE);
+        }
+        lookup_artifacts(&search->lookup, first, count, ids, found);
+    }
+
+    pthread_mutex_lock(&search->lock);
+    if (search->found + found > search->capacity) {
+        search->capacity = (search->found + found) * 2;
+        search->ids = realloc(search->ids,
+            sizeof(uint32_t) * search->capacity);
+        if (search->ids == NULL) {
+            fprintf(stderr, "Failed to allocate %llu ids\n",
+                (unsigned long long) search->capacity);
+            exit(EXIT_FAILURE);
+        }
+    }
+    memcpy(search->ids + search->found, ids, sizeof(uint32_t) * found);
+    search->found += found;
+    search->searched += count;
+    double now = seconds();
+    if (now - search->last_report >= REPORT_INTERVAL) {
+        search->last_report = now;
+        report(search);
+    }
+    pthread_mutex_unlock(&search->lock);
+    if (ids != block) free(ids);
+}
+
+/* reads the artifact in the image into pixels, the way expand_artifact_rgba()
+ * gives them with IMAGE_ALPHA. returns false if the image isn't
+ * GENERATED_SIZE square pixels scaled up by a whole factor.
+ */
+static bool read_artifact(const Image *image, uint32_t *pixels) {
+    if (image->width != image->height || image->width % GENERATED_SIZE != 0) {
+        return false;
+    }
+    const int scale = image->width / GENERATED_SIZE;
+    for (int y = 0; y < image->height; y++) {
+        for (int x = 0; x < image->width; x++) {
+            uint32_t pixel = image->pixels[(size_t) y * image->width + x];
+            // artifacts' pixels are either opaque or fully transparent
+            pixel = (pixel >> 24) >= 0x80 ? pixel | IMAGE_ALPHA : 0;
+            uint32_t *dest = &pixels[x / scale + y / scale * GENERATED_SIZE];
+            if (x % scale == 0 && y % scale == 0) {
+                *dest = pixel;
+            } else if (*dest != pixel) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static int compare_ids(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *) a;
+    uint32_t y = *(const uint32_t *) b;
+    return (x > y) - (x < y);
+}
+
+int lookup_main(int argc, char **argv) {
+    static Search search;
+    int threads = 0;
+    int version = ARTIFACT_V1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "j:v:")) != -1) {
+        bool valid = true;
+        switch (opt) {
+            case 'j': valid = parse_positive(optarg, &threads); break;
+            case 'v':
+                version = artifact_version_by_name(optarg);
+                valid = version >= 0;
+                break;
+            default: valid = false; break;
+        }
+        if (!valid) {
+            fputs(USAGE, stderr);
+            return EXIT_FAILURE;
+        }
+    }
+    uint32_t last = UINT32_MAX;
+    if ((optind + 1 != argc && optind + 3 != argc)
+    || (optind + 3 == argc && (!parse_id(argv[optind + 1], &search.first)
+        || !parse_id(argv[optind + 2], &last) || last < search.first))) {
+        fputs(USAGE, stderr);
+        return EXIT_FAILURE;
+    }
+    search.count = (uint64_t) last - search.first + 1;
+
+    const char *path = argv[optind];
+    Image image;
+    if (load_image(&image, path) != 0) {
+        fprintf(stderr, "Failed to load %s: %s\n", path, errno == EINVAL
+            ? "not a PNG or BMP that can be read" : strerror(errno));
+        return EXIT_FAILURE;
+    }
+    uint32_t pixels[GENERATED_SIZE * GENERATED_SIZE];
+    bool valid = read_artifact(&image, pixels);
+    free_image(&image);
+    if (!valid) {
+        fprintf(stderr, "%s is not an %dx%d artifact scaled up by a whole "
+            "factor\n", path, GENERATED_SIZE, GENERATED_SIZE);
+        return EXIT_FAILURE;
+    }
+    prepare_lookup(&search.lookup, pixels, IMAGE_ALPHA, version);
+    if (search.lookup.possible == 0) {
+        fprintf(stderr, "%s can't be an artifact: it has more than two "
+            "colors or none of the symmetries\n", path);
+        return EXIT_FAILURE;
+    }
+
+    pthread_mutex_init(&search.lock, NULL);
+    search.start_time = seconds();
+    search.last_report = search.start_time;
+    parallel_for(search.count, BLOCK_SIZE, threads, search_ids, &search);
+    report(&search);
+
+    qsort(search.ids, search.found, sizeof(uint32_t), compare_ids);
+    for (uint64_t i = 0; i < search.found; i++) {
+        printf("%u\n", search.ids[i]);
+    }
+    free(search.ids);
+    pthread_mutex_destroy(&search.lock);
+    return search.found > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
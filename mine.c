@@ -0,0 +1,491 @@
+/* mine.c - searches ranges of ids for artifacts matching some filters
+    author: Andrew Klinge
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <signal.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+
+#include "commands.h"
+#include "generator.h"
+#include "parallel.h"
+
+// ids per block. blocks are the unit of work and of checkpointing
+#define BLOCK_SIZE (1 << 20)
+// artifacts generated at once by a worker
+#define MINE_BATCH 256
+// max number of filters
+#define MAX_FILTERS 16
+
+static const char *USAGE =
+    "usage: artifactor mine [options] -f FILTER... FIRST LAST\n"
+    "Searches artifacts FIRST to LAST (inclusive) for ones matching all\n"
+    "filters and writes their ids to the output file, one per line.\n"
+    "A FILTER is NAME=MIN-MAX, NAME=MIN, NAME=MIN- or NAME=-MAX.\n"
+    "  -f FILTER    add a filter (see below)\n"
+    "  -o FILE      output file (default: mined.txt, or mined.ids with -b)\n"
+    "  -b           write the ids as binary uint32s instead of text, to\n"
+    "               browse with artifactor -l\n"
+    "  -c FILE      checkpoint file (default: output file + .checkpoint)\n"
+    "  -i SECONDS   seconds between checkpoints/progress (default: 10)\n"
+    "  -j THREADS   worker threads (default: number of cores)\n"
+    "  -v VERSION   generator: v1 (default) or v2\n"
+    "An interrupted search resumes from its checkpoint when run again.\n"
+    "Filters:\n";
+
+/* measures some property of an artifact that can be filtered on. */
+typedef struct Measure {
+    const char *name;
+    const char *description;
+    int (*measure)(const PackedArtifact *artifact);
+} Measure;
+
+static int measure_fill(const PackedArtifact *artifact) {
+    return __builtin_popcountll(artifact->mask);
+}
+
+static int measure_sym(const PackedArtifact *artifact) {
+    return artifact->sym & 3;
+}
+
+static int measure_rotate(const PackedArtifact *artifact) {
+    return artifact->sym >> 2;
+}
+
+static int measure_contrast(const PackedArtifact *artifact) {
+    // colors that aren't used by any pixel don't count
+    if ((artifact->mask & artifact->select) == 0 
+    || (artifact->mask & ~artifact->select) == 0) {
+        return 0;
+    }
+    int distance = 0;
+    for (int shift = 0; shift < 24; shift += 8) {
+        int d = ((artifact->col1 >> shift) & 0xff) 
+            - ((artifact->col2 >> shift) & 0xff);
+        distance += d * d;
+    }
+    int root = 0; // integer square root
+    while ((root + 1) * (root + 1) <= distance) root++;
+    return root;
+}
+
+static int measure_parts(const PackedArtifact *artifact) {
+    const uint64_t NOT_LEFT = ~0x0101010101010101ull; // without x = 0
+    const uint64_t NOT_RIGHT = ~0x8080808080808080ull; // without x = 7
+    uint64_t left = artifact->mask;
+    int parts = 0;
+    while (left) {
+        // flood fill the part containing the lowest pixel left
+        uint64_t part = left & -left;
+        uint64_t prev;
+        do {
+            prev = part;
+            part |= ((part << 8) | (part >> 8) | ((part << 1) & NOT_LEFT) 
+                | ((part >> 1) & NOT_RIGHT)) & left;
+        } while (part != prev);
+        left &= ~part;
+        parts++;
+    }
+    return parts;
+}
+
+static int measure_border(const PackedArtifact *artifact) {
+    return __builtin_popcountll(artifact->mask & 0xff818181818181ffull);
+}
+
+static const Measure MEASURES[] = {
+    {"fill", "filled pixels (0-64)", measure_fill},
+    {"sym", "symmetry (0 vertical, 1 horizontal, 2 quadrant, 3 diagonal)",
+        measure_sym},
+    {"rotate", "1 if the symmetry rotates, 0 if it reflects", measure_rotate},
+    {"contrast", "RGB distance between the two colors used (0-441)",
+        measure_contrast},
+    {"parts", "groups of (4-way) connected filled pixels", measure_parts},
+    {"border", "filled pixels touching the border (0-28)", measure_border},
+};
+#define MEASURE_COUNT (int) (sizeof(MEASURES) / sizeof(MEASURES[0]))
+
+typedef struct Filter {
+    const Measure *measure;
+    int min, max;
+} Filter;
+
+/* results of a finished block, waiting for the blocks before it. */
+typedef struct Block {
+    bool done;
+    uint32_t *ids; // matches
+    int count;
+} Block;
+
+typedef struct Mine {
+    uint32_t first; // first id of the search
+    uint64_t count; // ids in the search
+    Filter filters[MAX_FILTERS];
+    int filter_count;
+    char filter_args[512]; // filters as given (and -b, -v), to check on 
+        // resume
+    int version; // ARTIFACT_V* of the generator
+
+    FILE *output;
+    const char *output_name;
+    bool binary; // whether to write ids as uint32s instead of text
+    const char *checkpoint;
+    double interval;
+
+    atomic_bool failed; // whether writing the output failed, polled by 
+        // the workers to stop early
+    _Atomic uint64_t next_block; // first block not yet written to the 
+        // output. only written under the lock, but polled by the workers
+
+    pthread_mutex_t lock; // guards everything below
+    Block *blocks;
+    uint64_t output_bytes; // output size after writing next_block - 1
+    uint64_t matches;
+    double last_report;
+    double start_time;
+    uint64_t start_ids; // ids already searched when (re)starting
+} Mine;
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void on_interrupt(int sig) {
+    interrupted = 1;
+}
+
+/* parses a filter argument, returns false if invalid. */
+static bool parse_filter(const char *arg, Filter *filter) {
+    const char *eq = strchr(arg, '=');
+    if (eq == NULL) return false;
+    filter->measure = NULL;
+    for (int i = 0; i < MEASURE_COUNT; i++) {
+        if (strlen(MEASURES[i].name) == eq - arg 
+        && strncmp(MEASURES[i].name, arg, eq - arg) == 0) {
+            filter->measure = &MEASURES[i];
+        }
+    }
+    if (filter->measure == NULL) return false;
+
+    const char *range = eq + 1;
+    char *end;
+    filter->min = INT_MIN;
+    filter->max = INT_MAX;
+    if (*range != '-') {
+        filter->min = strtol(range, &end, 10);
+        if (end == range) return false;
+        range = end;
+        if (*range == '\0') {
+            filter->max = filter->min;
+            return true;
+        }
+        if (*range != '-') return false;
+    }
+    range++;
+    if (*range == '\0') return filter->min != INT_MIN;
+    filter->max = strtol(range, &end, 10);
+    return end != range && *end == '\0';
+}
+
+/* returns whether the artifact passes all filters. */
+static bool matches(const Mine *mine, const PackedArtifact *artifact) {
+    for (int i = 0; i < mine->filter_count; i++) {
+        const Filter *filter = &mine->filters[i];
+        int value = filter->measure->measure(artifact);
+        if (value < filter->min || value > filter->max) return false;
+    }
+    return true;
+}
+
+/* reports that writing the output failed and stops the search. the last
+ * good checkpoint is kept, so it can resume once there is room again.
+ */
+static void output_failed(Mine *mine) {
+    if (!atomic_exchange(&mine->failed, true)) {
+        fprintf(stderr, "Failed to write %s: %s\n", mine->output_name, 
+            strerror(errno));
+    }
+}
+
+/* saves the progress so far, replacing the previous checkpoint. returns 
+ * false if the output could not be written, leaving the old checkpoint.
+ */
+static bool save_checkpoint(Mine *mine) {
+    // the checkpoint must not get ahead of the output it describes
+    if (fflush(mine->output) != 0 || ferror(mine->output)) {
+        output_failed(mine);
+        return false;
+    }
+    fsync(fileno(mine->output));
+
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", mine->checkpoint);
+    FILE *file = fopen(tmp, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Failed to save checkpoint %s: %s\n", tmp, 
+            strerror(errno));
+        return true;
+    }
+    fprintf(file, "%u %llu %llu %llu %llu\n%s\n", mine->first, 
+        (unsigned long long) mine->count, 
+        (unsigned long long) mine->next_block,
+        (unsigned long long) mine->output_bytes, 
+        (unsigned long long) mine->matches, mine->filter_args);
+    fflush(file);
+    fsync(fileno(file));
+    fclose(file);
+    rename(tmp, mine->checkpoint);
+    return true;
+}
+
+/* restores progress from the checkpoint, if there is one for this search.
+ * returns false if there is one for a different search.
+ */
+static bool load_checkpoint(Mine *mine) {
+    FILE *file = fopen(mine->checkpoint, "r");
+    if (file == NULL) return true;
+    unsigned first;
+    unsigned long long count, next_block, output_bytes, matches;
+    char filters[sizeof(mine->filter_args) + 2] = "";
+    bool valid = fscanf(file, "%u %llu %llu %llu %llu\n", &first, &count, 
+        &next_block, &output_bytes, &matches) == 5;
+    if (fgets(filters, sizeof(filters), file) != NULL) {
+        filters[strcspn(filters, "\n")] = '\0';
+    }
+    fclose(file);
+    if (!valid || first != mine->first || count != mine->count 
+    || strcmp(filters, mine->filter_args) != 0) {
+        fprintf(stderr, "Checkpoint %s is for a different search\n", 
+            mine->checkpoint);
+        return false;
+    }
+    mine->next_block = next_block;
+    mine->output_bytes = output_bytes;
+    mine->matches = matches;
+    return true;
+}
+
+/* prints progress. */
+static void report(Mine *mine, uint64_t searched) {
+    double elapsed = seconds() - mine->start_time;
+    fprintf(stderr, "%llu/%llu ids (%.1f%%), %llu matches, %.0f ids/s\n",
+        (unsigned long long) searched, (unsigned long long) mine->count, 
+        100.0 * searched / mine->count, (unsigned long long) mine->matches,
+        (searched - mine->start_ids) / elapsed);
+}
+
+/* records the results of a finished block and writes out all blocks that
+ * are now finished in order, so the output stays sorted.
+ */
+static void finish_block(Mine *mine, uint64_t block, uint32_t *ids, 
+        int count) {
+    pthread_mutex_lock(&mine->lock);
+    if (mine->failed) {
+        free(ids);
+        pthread_mutex_unlock(&mine->lock);
+        return;
+    }
+    mine->blocks[block] = (Block) {.done = true, .ids = ids, .count = count};
+    const uint64_t blocks = (mine->count + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    bool wrote = false;
+    while (mine->next_block < blocks && mine->blocks[mine->next_block].done) {
+        Block *next = &mine->blocks[mine->next_block];
+        uint64_t bytes = 0;
+        bool ok = true;
+        if (mine->binary) {
+            size_t written = fwrite(next->ids, sizeof(uint32_t), next->count, 
+                mine->output);
+            bytes = sizeof(uint32_t) * written;
+            ok = written == (size_t) next->count;
+        } else {
+            for (int i = 0; i < next->count && ok; i++) {
+                int n = fprintf(mine->output, "%u\n", next->ids[i]);
+                if (n > 0) bytes += n;
+                ok = n > 0;
+            }
+        }
+        if (!ok || ferror(mine->output)) {
+            output_failed(mine);
+            break;
+        }
+        mine->output_bytes += bytes;
+        mine->matches += next->count;
+        free(next->ids);
+        next->ids = NULL;
+        mine->next_block++;
+        wrote = true;
+    }
+    double now = seconds();
+    if (wrote && !mine->failed && now - mine->last_report >= mine->interval) {
+        mine->last_report = now;
+        if (save_checkpoint(mine)) {
+            uint64_t searched = mine->next_block * BLOCK_SIZE;
+            report(mine, searched < mine->count ? searched : mine->count);
+        }
+    }
+    pthread_mutex_unlock(&mine->lock);
+}
+
+/* searches blocks [start, start + count). */
+static void search_blocks(void *ctx, uint64_t start, uint64_t count, 
+        int worker) {
+    Mine *mine = ctx;
+    PackedArtifact artifacts[MINE_BATCH];
+    for (uint64_t block = start; block < start + count; block++) {
+        if (interrupted || mine->failed || block < mine->next_block) {
+            continue;
+        }
+        uint64_t first = block * BLOCK_SIZE;
+        uint64_t size = mine->count - first;
+        if (size > BLOCK_SIZE) size = BLOCK_SIZE;
+
+        int capacity = 64;
+        int found = 0;
+        uint32_t *ids = malloc(sizeof(uint32_t) * capacity);
+        if (ids == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+        for (uint64_t i = 0; i < size && !interrupted && !mine->failed; 
+                i += MINE_BATCH) {
+            int n = size - i < MINE_BATCH ? size - i : MINE_BATCH;
+            uint32_t id = mine->first + first + i;
+            generate_artifacts_packed(artifacts, id, n, mine->version);
+            for (int j = 0; j < n; j++) {
+                if (!matches(mine, &artifacts[j])) continue;
+                if (found == capacity) {
+                    capacity *= 2;
+                    uint32_t *grown = realloc(ids, 
+                        sizeof(uint32_t) * capacity);
+                    if (grown == NULL) {
+                        fprintf(stderr, "Out of memory\n");
+                        exit(EXIT_FAILURE);
+                    }
+                    ids = grown;
+                }
+                ids[found++] = id + j;
+            }
+        }
+        // an interrupted block is searched again on resume
+        if (interrupted || mine->failed) {
+            free(ids);
+            continue;
+        }
+        finish_block(mine, block, ids, found);
+    }
+}
+
+static void usage(void) {
+    fputs(USAGE, stderr);
+    for (int i = 0; i < MEASURE_COUNT; i++) {
+        fprintf(stderr, "  %-12s %s\n", MEASURES[i].name, 
+            MEASURES[i].description);
+    }
+}
+
+int mine_main(int argc, char **argv) {
+    static Mine mine;
+    const char *output = NULL;
+    int threads = 0;
+    int interval = 10;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "f:o:bc:i:j:v:")) != -1) {
+        bool valid = true;
+        switch (opt) {
+            case 'f':
+                valid = mine.filter_count < MAX_FILTERS 
+                    && parse_filter(optarg, &mine.filters[mine.filter_count])
+                    && strlen(mine.filter_args) + strlen(optarg) + 11 
+                    < sizeof(mine.filter_args); // room for " -b -v v2" too
+                if (valid) {
+                    if (mine.filter_count++ > 0) strcat(mine.filter_args, " ");
+                    strcat(mine.filter_args, optarg);
+                }
+                break;
+            case 'o': output = optarg; break;
+            case 'b': mine.binary = true; break;
+            case 'c': mine.checkpoint = optarg; break;
+            case 'i': valid = parse_positive(optarg, &interval); break;
+            case 'j': valid = parse_positive(optarg, &threads); break;
+            case 'v':
+                mine.version = artifact_version_by_name(optarg);
+                valid = mine.version >= 0;
+                break;
+            default: valid = false; break;
+        }
+        if (!valid) {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+    uint32_t last;
+    if (optind + 2 != argc || !parse_id(argv[optind], &mine.first) 
+    || !parse_id(argv[optind + 1], &last) || last < mine.first) {
+        usage();
+        return EXIT_FAILURE;
+    }
+    mine.count = (uint64_t) last - mine.first + 1;
+    mine.interval = interval;
+    if (output == NULL) output = mine.binary ? "mined.ids" : "mined.txt";
+    mine.output_name = output;
+    // don't resume a text search as a binary one or the other way around
+    if (mine.binary) strcat(mine.filter_args, " -b");
+    // nor one of a version as another (v1 is left out, as it was before v2)
+    if (mine.version != ARTIFACT_V1) {
+        strcat(mine.filter_args, " -v ");
+        strcat(mine.filter_args, artifact_version_name(mine.version));
+    }
+
+    char checkpoint[PATH_MAX];
+    if (mine.checkpoint == NULL) {
+        snprintf(checkpoint, sizeof(checkpoint), "%s.checkpoint", output);
+        mine.checkpoint = checkpoint;
+    }
+    if (!load_checkpoint(&mine)) return EXIT_FAILURE;
+
+    // continue the output where the checkpoint left it
+    mine.output = fopen(output, mine.next_block > 0 ? "r+" : "w");
+    if (mine.output == NULL 
+    || (mine.next_block > 0 && (ftruncate(fileno(mine.output), 
+        mine.output_bytes) != 0 || fseek(mine.output, 0, SEEK_END) != 0))) {
+        fprintf(stderr, "Failed to open %s: %s\n", output, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    const uint64_t blocks = (mine.count + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    mine.blocks = calloc(blocks, sizeof(Block));
+    if (mine.blocks == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        fclose(mine.output);
+        return EXIT_FAILURE;
+    }
+    pthread_mutex_init(&mine.lock, NULL);
+    if (mine.next_block > 0) {
+        fprintf(stderr, "Resuming from checkpoint %s\n", mine.checkpoint);
+    }
+
+    signal(SIGINT, on_interrupt);
+    signal(SIGTERM, on_interrupt);
+    mine.start_time = seconds();
+    mine.last_report = mine.start_time;
+    mine.start_ids = mine.next_block * BLOCK_SIZE;
+    parallel_for(blocks, 1, threads, search_blocks, &mine);
+
+    uint64_t searched = mine.next_block * BLOCK_SIZE;
+    report(&mine, searched < mine.count ? searched : mine.count);
+    bool complete = mine.next_block >= blocks;
+    if (!complete && !mine.failed && save_checkpoint(&mine)) {
+        fprintf(stderr, "Interrupted, run again to resume\n");
+    }
+    if (fclose(mine.output) != 0) output_failed(&mine);
+    // the checkpoint is only done with once all of the output is written
+    if (complete && !mine.failed) remove(mine.checkpoint);
+    for (uint64_t i = 0; i < blocks; i++) free(mine.blocks[i].ids);
+    free(mine.blocks);
+    pthread_mutex_destroy(&mine.lock);
+    return complete && !mine.failed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
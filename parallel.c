@@ -0,0 +1,71 @@
+/* parallel.c - spreads work over a pool of worker threads
+    author: Andrew Klinge
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "parallel.h"
+
+typedef struct Pool {
+    uint64_t total;
+    uint64_t chunk;
+    _Atomic uint64_t next; // start of next chunk to hand out
+    ParallelWork work;
+    void *ctx;
+} Pool;
+
+typedef struct Worker {
+    Pool *pool;
+    int index;
+} Worker;
+
+static void *run_worker(void *arg) {
+    Worker *worker = arg;
+    Pool *pool = worker->pool;
+    while (1) {
+        uint64_t start = atomic_fetch_add(&pool->next, pool->chunk);
+        if (start >= pool->total) break;
+        uint64_t count = pool->total - start;
+        if (count > pool->chunk) count = pool->chunk;
+        pool->work(pool->ctx, start, count, worker->index);
+    }
+    return NULL;
+}
+
+int parallel_threads(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int) n : 1;
+}
+
+void parallel_for(uint64_t total, uint64_t chunk, int threads, 
+        ParallelWork work, void *ctx) {
+    if (threads <= 0) threads = parallel_threads();
+    if (chunk == 0) chunk = 1;
+    Pool pool = {.total = total, .chunk = chunk, .work = work, .ctx = ctx};
+    atomic_init(&pool.next, 0);
+
+    Worker *workers = malloc(sizeof(Worker) * threads);
+    pthread_t *ids = malloc(sizeof(pthread_t) * threads);
+    if (workers == NULL || ids == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    // worker 0 runs on the calling thread
+    for (int i = 0; i < threads; i++) {
+        workers[i] = (Worker) {.pool = &pool, .index = i};
+        if (i > 0 && pthread_create(&ids[i], NULL, run_worker, &workers[i])) {
+            fprintf(stderr, "Failed to start worker thread\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    run_worker(&workers[0]);
+    for (int i = 1; i < threads; i++) {
+        pthread_join(ids[i], NULL);
+    }
+    free(workers);
+    free(ids);
+}
@@ -0,0 +1,27 @@
+/* parallel.c - spreads work over a pool of worker threads
+    author: Andrew Klinge
+*/
+
+#ifndef _PARALLEL_H_
+#define _PARALLEL_H_
+
+#include <stdint.h>
+
+/* does the work for items [start, start + count) on the given worker (0 to
+ * the number of threads - 1). ctx is shared by all workers.
+ */
+typedef void (*ParallelWork)(void *ctx, uint64_t start, uint64_t count, 
+    int worker);
+
+/* returns the default number of worker threads (number of online cores). */
+int parallel_threads(void);
+
+/* Does the work for items [0, total) in chunks of the given size, handing out
+ * the next chunk to whichever worker is free. Returns once all are done.
+ *
+ * threads - number of worker threads (<= 0 for parallel_threads())
+ */
+void parallel_for(uint64_t total, uint64_t chunk, int threads, 
+    ParallelWork work, void *ctx);
+
+#endif
@@ -0,0 +1,135 @@
+/* profile.c - scoped timers and counters for finding where time goes
+    author: Andrew Klinge
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "profile.h"
+
+#ifdef PROFILE
+
+// events kept, later ones are dropped. ~40 MB
+#define MAX_EVENTS (1 << 20)
+
+/* a timed scope, or the counts of a frame if name is NULL. */
+typedef struct ProfileEvent {
+    const char *name;
+    long long start, duration; // us
+    int thread;
+    int counts[PROFILE_COUNTERS];
+} ProfileEvent;
+
+static ProfileEvent events[MAX_EVENTS];
+static atomic_int event_count;
+static atomic_int thread_count;
+static _Thread_local int thread_id = -1;
+static atomic_int counts[PROFILE_COUNTERS]; // of the current frame
+static long long frame_start;
+static ProfileStats stats;
+
+static long long epoch; // us of the first call to now()
+static pthread_once_t epoch_once = PTHREAD_ONCE_INIT;
+
+/* returns the monotonic clock in us. */
+static long long clock_us() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1000000LL + time.tv_nsec / 1000;
+}
+
+static void set_epoch(void) {
+    epoch = clock_us();
+}
+
+/* returns us since the first call, on any thread. */
+static long long now() {
+    pthread_once(&epoch_once, set_epoch);
+    return clock_us() - epoch;
+}
+
+/* returns a new event to fill in, or NULL if there is no more room. */
+static ProfileEvent *add_event() {
+    if (thread_id == -1) thread_id = atomic_fetch_add(&thread_count, 1);
+    int i = atomic_fetch_add(&event_count, 1);
+    if (i >= MAX_EVENTS) return NULL;
+    events[i].thread = thread_id;
+    return &events[i];
+}
+
+ProfileScope profile_begin(const char *name) {
+    return (ProfileScope) {.name = name, .start = now()};
+}
+
+void profile_end(ProfileScope *scope) {
+    long long end = now();
+    ProfileEvent *event = add_event();
+    if (event == NULL) return;
+    event->name = scope->name;
+    event->start = scope->start;
+    event->duration = end - scope->start;
+}
+
+void profile_count(ProfileCounter counter, int amount) {
+    atomic_fetch_add(&counts[counter], amount);
+}
+
+void profile_frame_begin(void) {
+    frame_start = now();
+}
+
+void profile_frame_end(void) {
+    long long end = now();
+    stats.frame_ms = (end - frame_start) / 1000.0;
+    for (int i = 0; i < PROFILE_COUNTERS; i++) {
+        stats.counts[i] = atomic_exchange(&counts[i], 0);
+    }
+    ProfileEvent *event = add_event();
+    if (event == NULL) return;
+    event->name = NULL;
+    event->start = end;
+    event->duration = 0;
+    for (int i = 0; i < PROFILE_COUNTERS; i++) {
+        event->counts[i] = stats.counts[i];
+    }
+}
+
+const ProfileStats *profile_stats(void) {
+    return &stats;
+}
+
+int profile_save(const char *path) {
+    static const char *COUNTER_NAMES[PROFILE_COUNTERS] = {"tiles", "uploads"};
+
+    FILE *file = fopen(path, "w");
+    if (file == NULL) return -1;
+    int count = atomic_load(&event_count);
+    if (count > MAX_EVENTS) count = MAX_EVENTS;
+    fputs("{\"traceEvents\":[\n", file);
+    for (int i = 0; i < count; i++) {
+        const ProfileEvent *event = &events[i];
+        if (event->name != NULL) {
+            fprintf(file, "{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%lld,"
+                "\"dur\":%lld,\"pid\":1,\"tid\":%d}", event->name, 
+                event->start, event->duration, event->thread);
+        } else {
+            fprintf(file, "{\"name\":\"frame\",\"ph\":\"C\",\"ts\":%lld,"
+                "\"pid\":1,\"tid\":%d,\"args\":{", event->start, 
+                event->thread);
+            for (int j = 0; j < PROFILE_COUNTERS; j++) {
+                fprintf(file, "%s\"%s\":%d", j > 0 ? "," : "", 
+                    COUNTER_NAMES[j], event->counts[j]);
+            }
+            fputs("}}", file);
+        }
+        fputs(i + 1 < count ? ",\n" : "\n", file);
+    }
+    fputs("]}\n", file);
+    if (fclose(file) != 0) return -1;
+    return 0;
+}
+
+#endif
@@ -0,0 +1,65 @@
+/* profile.c - scoped timers and counters for finding where time goes
+    author: Andrew Klinge
+*/
+
+#ifndef _PROFILE_H_
+#define _PROFILE_H_
+
+/* Everything here compiles to nothing unless built with -DPROFILE (see 
+ * `make profile`). Timed scopes and frames are recorded from any thread, and
+ * saved as a Chrome trace_event file (open in chrome://tracing or Perfetto).
+ */
+
+/* things counted per frame. */
+typedef enum ProfileCounter {
+    PROFILE_TILES, // artifacts generated
+    PROFILE_UPLOADS, // texture uploads
+    PROFILE_COUNTERS
+} ProfileCounter;
+
+/* totals of the last finished frame. */
+typedef struct ProfileStats {
+    double frame_ms;
+    int counts[PROFILE_COUNTERS];
+} ProfileStats;
+
+#ifdef PROFILE
+
+typedef struct ProfileScope {
+    const char *name;
+    long long start; // us
+} ProfileScope;
+
+ProfileScope profile_begin(const char *name);
+void profile_end(ProfileScope *scope);
+void profile_count(ProfileCounter counter, int amount);
+void profile_frame_begin(void);
+void profile_frame_end(void);
+const ProfileStats *profile_stats(void);
+int profile_save(const char *path);
+
+#define PROFILE_JOIN_(a, b) a##b
+#define PROFILE_JOIN(a, b) PROFILE_JOIN_(a, b)
+
+/* times from here to the end of the enclosing block. */
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_JOIN(profile_, __LINE__) \
+    __attribute__((cleanup(profile_end))) = profile_begin(name)
+/* adds to a counter of the current frame. */
+#define PROFILE_COUNT(counter, amount) profile_count(counter, amount)
+/* a frame is the work between these, and the counts since the last one. */
+#define PROFILE_FRAME_BEGIN() profile_frame_begin()
+#define PROFILE_FRAME_END() profile_frame_end()
+/* saves everything recorded as a trace_event JSON file. */
+#define PROFILE_SAVE(path) profile_save(path)
+
+#else
+
+#define PROFILE_SCOPE(name)
+#define PROFILE_COUNT(counter, amount)
+#define PROFILE_FRAME_BEGIN()
+#define PROFILE_FRAME_END()
+#define PROFILE_SAVE(path)
+
+#endif
+
+#endif
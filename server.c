@@ -0,0 +1,872 @@
+/* server.c - serves artifact images over HTTP on localhost
+    author: Andrew Klinge
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <signal.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+
+#include "commands.h"
+#include "generator.h"
+#include "image.h"
+#include "parallel.h"
+
+// bumped whenever the encoded images change, so clients don't keep old ones
+#define ETAG_VERSION 2
+#define REQUEST_MAX 4096 // bytes of a request line and headers
+#define HEADER_MAX 512 // bytes of response headers
+#define KEY_MAX 64 // bytes of a cache key
+#define MAX_EVENTS 256
+#define MAX_SCALE 64
+#define MAX_SHEET 4096 // artifacts in a sheet
+#define MAX_DIMENSION 4096 // pixels wide or high of an image
+
+static const char *USAGE =
+    "usage: artifactor serve [options]\n"
+    "Serves artifacts as PNG images over HTTP on localhost:\n"
+    "  /artifact/ID.png?scale=N            one artifact (or ID.gif)\n"
+    "  /sheet?start=ID&count=N&scale=N     a sprite sheet of N artifacts\n"
+    "Both also take size=8|16|32, symmetry=drawn|d4|rot4|point and\n"
+    "version=v1|v2 (of the generator).\n"
+    "  -p PORT      port to listen on (default: 8080)\n"
+    "  -c MB        size of the cache of encoded images (default: 64)\n"
+    "  -i SECONDS   seconds between reports of requests/s (default: 5)\n"
+    "  -j THREADS   worker threads generating images (default: cores)\n";
+
+/* an encoded image, shared by the cache and the connections sending it. */
+typedef struct Response {
+    atomic_int refs; // freed when the last one lets go
+    char key[KEY_MAX];
+    int type; // IMAGE_PNG or IMAGE_GIF
+    uint8_t *body;
+    size_t size;
+    struct Response *prev, *next; // least recently used order, newest first
+    struct Response *chain; // next in the same hash bucket
+} Response;
+
+/* least recently used cache of responses, by key. */
+typedef struct Cache {
+    pthread_mutex_t lock;
+    Response **buckets;
+    size_t bucket_count; // a power of 2
+    Response *newest, *oldest;
+    size_t bytes; // of all bodies in the cache
+    size_t capacity;
+} Cache;
+
+/* what a request asks for. */
+typedef struct Request {
+    bool sheet;
+    int type; // IMAGE_PNG or IMAGE_GIF
+    uint32_t start; // id of the artifact, or of the first in the sheet
+    int count; // artifacts in the sheet
+    int scale;
+    ArtifactFormat format;
+} Request;
+
+typedef struct Connection {
+    int fd;
+    char in[REQUEST_MAX + 1]; // received, not yet handled (0-terminated)
+    size_t in_size;
+    char head[HEADER_MAX]; // headers of the response being sent
+    size_t head_size;
+    Response *body; // of the response being sent, or NULL
+    const char *error; // or a short error body
+    size_t sent; // bytes of head and body sent
+    bool sending;
+    bool working; // a worker is generating its response
+    bool head_only; // HEAD request
+    bool keep_alive;
+    bool closed; // the client is gone, free once the worker is done
+} Connection;
+
+/* an image for a worker to generate and encode. */
+typedef struct Job {
+    Connection *conn;
+    Request request;
+    char key[KEY_MAX];
+    Response *response; // the result
+    struct Job *next;
+} Job;
+
+/* jobs handed between the event loop and the workers. */
+typedef struct JobQueue {
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    Job *first, *last;
+} JobQueue;
+
+static Cache cache;
+static JobQueue todo; // for the workers
+static JobQueue done; // for the event loop
+static int done_fd; // eventfd, signalled when there are done jobs
+static int epoll_fd;
+static atomic_bool running;
+static volatile sig_atomic_t interrupted = 0;
+// statistics, since the last report (only the event loop touches them)
+static uint64_t requests, not_modified, hits, misses;
+static uint64_t total_requests;
+
+static void on_interrupt(int sig) {
+    interrupted = 1;
+}
+
+/* adds the job to the end of the queue. */
+static void push_job(JobQueue *queue, Job *job) {
+    job->next = NULL;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->last != NULL) queue->last->next = job;
+    else queue->first = job;
+    queue->last = job;
+    pthread_cond_signal(&queue->ready);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+/* takes the first job from the queue, waiting for one while the server is
+ * running. returns NULL once it stops.
+ */
+static Job *take_job(JobQueue *queue) {
+    pthread_mutex_lock(&queue->lock);
+    while (queue->first == NULL && atomic_load(&running)) {
+        pthread_cond_wait(&queue->ready, &queue->lock);
+    }
+    Job *job = atomic_load(&running) ? queue->first : NULL;
+    if (job != NULL) {
+        queue->first = job->next;
+        if (queue->first == NULL) queue->last = NULL;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return job;
+}
+
+/* takes all jobs from the queue, without waiting. returns NULL if there are
+ * none.
+ */
+static Job *take_jobs(JobQueue *queue) {
+    pthread_mutex_lock(&queue->lock);
+    Job *jobs = queue->first;
+    queue->first = queue->last = NULL;
+    pthread_mutex_unlock(&queue->lock);
+    return jobs;
+}
+
+static void release(Response *response) {
+    if (response != NULL && atomic_fetch_sub(&response->refs, 1) == 1) {
+        free(response->body);
+        free(response);
+    }
+}
+
+/* returns the hash bucket of the given key (FNV-1a). */
+static Response **bucket(const char *key) {
+    uint64_t hash = 0xcbf29ce484222325;
+    for (; *key; key++) hash = (hash ^ (uint8_t) *key) * 0x100000001b3;
+    return &cache.buckets[hash & (cache.bucket_count - 1)];
+}
+
+/* unlinks the response from the recently used list. */
+static void unlink_used(Response *response) {
+    if (response->prev != NULL) response->prev->next = response->next;
+    else cache.newest = response->next;
+    if (response->next != NULL) response->next->prev = response->prev;
+    else cache.oldest = response->prev;
+}
+
+/* links the response in as the most recently used. */
+static void link_used(Response *response) {
+    response->prev = NULL;
+    response->next = cache.newest;
+    if (cache.newest != NULL) cache.newest->prev = response;
+    cache.newest = response;
+    if (cache.oldest == NULL) cache.oldest = response;
+}
+
+/* returns the cached response for the key (with a reference for the
+ * caller), or NULL.
+ */
+static Response *cache_get(const char *key) {
+    pthread_mutex_lock(&cache.lock);
+    Response *response = *bucket(key);
+    while (response != NULL && strcmp(response->key, key) != 0) {
+        response = response->chain;
+    }
+    if (response != NULL) {
+        unlink_used(response);
+        link_used(response);
+        atomic_fetch_add(&response->refs, 1);
+    }
+    pthread_mutex_unlock(&cache.lock);
+    return response;
+}
+
+/* adds the response to the cache, evicting the least recently used ones to
+ * make room. does nothing if it's already there (another worker made it).
+ */
+static void cache_put(Response *response) {
+    if (response->size > cache.capacity) return;
+    pthread_mutex_lock(&cache.lock);
+    Response **head = bucket(response->key);
+    for (Response *r = *head; r != NULL; r = r->chain) {
+        if (strcmp(r->key, response->key) == 0) {
+            pthread_mutex_unlock(&cache.lock);
+            return;
+        }
+    }
+    while (cache.bytes + response->size > cache.capacity) {
+        Response *old = cache.oldest;
+        unlink_used(old);
+        Response **link = bucket(old->key);
+        while (*link != old) link = &(*link)->chain;
+        *link = old->chain;
+        cache.bytes -= old->size;
+        release(old);
+    }
+    atomic_fetch_add(&response->refs, 1);
+    response->chain = *head;
+    *head = response;
+    link_used(response);
+    cache.bytes += response->size;
+    pthread_mutex_unlock(&cache.lock);
+}
+
+/* returns the cache key (also the etag) of a request. */
+static void request_key(const Request *request, char *key) {
+    if (request->sheet) {
+        snprintf(key, KEY_MAX, "v%d-s%u-%d-%d-%d-%d-%d", ETAG_VERSION,
+            request->start, request->count, request->scale,
+            request->format.size, request->format.symmetry, 
+            request->format.version);
+    } else {
+        snprintf(key, KEY_MAX, "v%d-a%u-%d-%d-%d-%d.%s", ETAG_VERSION,
+            request->start, request->scale, request->format.size,
+            request->format.symmetry, request->format.version, 
+            image_format_name(request->type));
+    }
+}
+
+/* returns the columns of a sheet of count artifacts, so it's about square. */
+static int sheet_cols(int count) {
+    int cols = 1;
+    while (cols * cols < count) cols++;
+    return cols;
+}
+
+/* generates and encodes the image of a request, with the encoder of the 
+ * worker. returns NULL if out of memory.
+ */
+static Response *generate_response(const Request *request, const char *key,
+        Encoder *encoder) {
+    const int size = request->format.size;
+    uint32_t pixels[ARTIFACT_BATCH_LANES * ARTIFACT_MAX_SIZE
+        * ARTIFACT_MAX_SIZE];
+    Image image = {.width = size, .height = size, .pixels = pixels};
+    if (request->sheet) {
+        // drawn unscaled, it's scaled as it's encoded
+        const int cols = sheet_cols(request->count);
+        image = create_image(cols * size, 
+            (request->count + cols - 1) / cols * size);
+        for (int i = 0; i < request->count; i += ARTIFACT_BATCH_LANES) {
+            int n = request->count - i < ARTIFACT_BATCH_LANES 
+                ? request->count - i : ARTIFACT_BATCH_LANES;
+            generate_artifacts_rgba(pixels, request->start + i, n,
+                &request->format, IMAGE_ALPHA);
+            for (int j = 0; j < n; j++) {
+                draw_pixels(&image, pixels + j * size * size, size,
+                    (i + j) % cols * size, (i + j) / cols * size, 1);
+            }
+        }
+    } else {
+        generate_artifacts_rgba(pixels, request->start, 1, &request->format,
+            IMAGE_ALPHA);
+    }
+    int result = encode_image(encoder, &image, request->scale, request->type);
+    if (request->sheet) free_image(&image);
+    Response *response = result == 0 ? calloc(1, sizeof(Response)) : NULL;
+    if (response == NULL) return NULL;
+    // the encoder's buffer is reused, the response keeps its own
+    response->body = malloc(encoder->size);
+    if (response->body == NULL) {
+        free(response);
+        return NULL;
+    }
+    memcpy(response->body, encoder->data, encoder->size);
+    response->size = encoder->size;
+    response->type = request->type;
+    atomic_init(&response->refs, 1);
+    strcpy(response->key, key);
+    return response;
+}
+
+/* worker thread. generates the images of jobs, then hands them back. */
+static void *work(void *data) {
+    Encoder encoder = {0};
+    Job *job;
+    while ((job = take_job(&todo)) != NULL) {
+        // another worker may have just made the same one
+        job->response = cache_get(job->key);
+        if (job->response == NULL) {
+            job->response = generate_response(&job->request, job->key, 
+                &encoder);
+            if (job->response != NULL) cache_put(job->response);
+        }
+        push_job(&done, job);
+        uint64_t one = 1;
+        if (write(done_fd, &one, sizeof(one)) < 0) perror("eventfd");
+    }
+    free_encoder(&encoder);
+    return NULL;
+}
+
+/* returns the value of a parameter in a query string ("a=1&b=2") as an int,
+ * or the default if it isn't there. returns false if it's invalid.
+ */
+static bool query_int(const char *query, const char *name, long long min,
+        long long max, long long *value) {
+    const size_t length = strlen(name);
+    for (const char *p = query; p != NULL && *p; p = strchr(p, '&')) {
+        if (*p == '&') p++;
+        if (strncmp(p, name, length) != 0 || p[length] != '=') continue;
+        char *end;
+        errno = 0;
+        long long parsed = strtoll(p + length + 1, &end, 10);
+        if (errno || end == p + length + 1 || (*end != '\0' && *end != '&')
+        || parsed < min || parsed > max) {
+            return false;
+        }
+        *value = parsed;
+    }
+    return true;
+}
+
+/* like query_int(), for a value given by name (such as the symmetry's), 
+ * which by_name() turns into the value or -1.
+ */
+static bool query_named(const char *query, const char *name, 
+        int (*by_name)(const char *), int *value) {
+    const size_t length = strlen(name);
+    for (const char *p = query; p != NULL && *p; p = strchr(p, '&')) {
+        if (*p == '&') p++;
+        if (strncmp(p, name, length) != 0 || p[length] != '=') continue;
+        char given[16];
+        size_t given_length = strcspn(p + length + 1, "&");
+        if (given_length >= sizeof(given)) return false;
+        memcpy(given, p + length + 1, given_length);
+        given[given_length] = '\0';
+        *value = by_name(given);
+        if (*value < 0) return false;
+    }
+    return true;
+}
+
+/* parses the target of a request (path and query). returns the HTTP status
+ * it gets: 200, or 400/404 if it's bad.
+ */
+static int parse_target(char *target, Request *request) {
+    char *query = strchr(target, '?');
+    if (query != NULL) *query++ = '\0';
+    long long start = 0, count = 1, scale = 1, size = GENERATED_SIZE;
+    *request = (Request) {.format = ARTIFACT_DEFAULT_FORMAT, 
+        .type = IMAGE_PNG};
+    if (strncmp(target, "/artifact/", 10) == 0) {
+        char *end;
+        errno = 0;
+        start = strtoll(target + 10, &end, 10);
+        if (errno || end == target + 10 || *end != '.' || target[10] == '-' 
+        || start > UINT32_MAX) {
+            return 404;
+        }
+        // an artifact has few enough colors for either
+        request->type = image_format_by_name(end + 1);
+        if (request->type != IMAGE_PNG && request->type != IMAGE_GIF) {
+            return 404;
+        }
+    } else if (strcmp(target, "/sheet") == 0) {
+        request->sheet = true;
+        if (!query_int(query, "start", 0, UINT32_MAX, &start)
+        || !query_int(query, "count", 1, MAX_SHEET, &count)
+        || start + count - 1 > UINT32_MAX) { // ids don't wrap around
+            return 400;
+        }
+    } else {
+        return 404;
+    }
+    if (!query_int(query, "scale", 1, MAX_SCALE, &scale)
+    || !query_int(query, "size", 1, ARTIFACT_MAX_SIZE, &size)
+    || !artifact_size_supported(size)
+    || !query_named(query, "symmetry", artifact_symmetry_by_name, 
+        &request->format.symmetry)
+    || !query_named(query, "version", artifact_version_by_name,
+        &request->format.version)) {
+        return 400;
+    }
+    request->start = start;
+    request->count = count;
+    request->scale = scale;
+    request->format.size = size;
+    if (sheet_cols(count) * size * scale > MAX_DIMENSION) return 400;
+    return 200;
+}
+
+/* returns the value of a header in the request headers, or NULL. values end
+ * at "\r\n", or at the end of the string for the last header.
+ */
+static const char *find_header(const char *headers, const char *name) {
+    const size_t length = strlen(name);
+    for (const char *p = headers; p != NULL; p = strstr(p, "\r\n")) {
+        p += 2;
+        if (strncasecmp(p, name, length) == 0 && p[length] == ':') {
+            p += length + 1;
+            while (*p == ' ' || *p == '\t') p++;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/* returns whether a header value (up to "\r\n" or the end of the string) 
+ * is a comma-separated list containing the given token. tokens are compared
+ * whole, without the whitespace around them.
+ */
+static bool header_has(const char *value, const char *token, 
+        bool ignore_case) {
+    if (value == NULL) return false;
+    const char *end = value + strcspn(value, "\r\n");
+    const size_t length = strlen(token);
+    while (value < end) {
+        while (value < end && (*value == ' ' || *value == '\t')) value++;
+        const char *next = value;
+        while (next < end && *next != ',') next++;
+        const char *last = next;
+        while (last > value && (last[-1] == ' ' || last[-1] == '\t')) last--;
+        if ((size_t) (last - value) == length && (ignore_case 
+            ? strncasecmp(value, token, length) 
+            : strncmp(value, token, length)) == 0) {
+            return true;
+        }
+        value = next + 1;
+    }
+    return false;
+}
+
+static const char *status_text(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 431: return "Request Header Fields Too Large";
+        default: return "Internal Server Error";
+    }
+}
+
+/* sets the epoll events the connection waits for. */
+static void watch(Connection *conn, uint32_t events) {
+    struct epoll_event event = {.events = events, .data.ptr = conn};
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn->fd, &event);
+}
+
+/* starts sending a response: an image (body), an error (status != 200 and
+ * != 304) or a 304.
+ */
+static void respond(Connection *conn, int status, Response *body,
+        const char *key) {
+    size_t length = 0;
+    if (body != NULL) {
+        length = body->size;
+    } else if (status != 304) {
+        conn->error = status_text(status);
+        length = strlen(conn->error);
+    }
+    int n = snprintf(conn->head, HEADER_MAX, "HTTP/1.1 %d %s\r\n"
+        "Connection: %s\r\n", status, status_text(status),
+        conn->keep_alive ? "keep-alive" : "close");
+    if (key != NULL) {
+        // images never change for the same etag
+        n += snprintf(conn->head + n, HEADER_MAX - n, "ETag: \"%s\"\r\n"
+            "Cache-Control: public, max-age=31536000, immutable\r\n", key);
+    }
+    if (status != 304) {
+        n += snprintf(conn->head + n, HEADER_MAX - n, "Content-Type: %s\r\n"
+            "Content-Length: %zu\r\n", body == NULL ? "text/plain" 
+            : body->type == IMAGE_GIF ? "image/gif" : "image/png", length);
+    }
+    n += snprintf(conn->head + n, HEADER_MAX - n, "\r\n");
+    conn->head_size = n;
+    conn->body = body;
+    if (conn->head_only || status == 304) {
+        conn->body = NULL;
+        conn->error = NULL;
+        release(body);
+    }
+    conn->sent = 0;
+    conn->sending = true;
+    requests++;
+    watch(conn, EPOLLOUT);
+}
+
+/* handles the request at the start of the connection's input, if it has all
+ * of it yet.
+ */
+static void handle_request(Connection *conn) {
+    conn->in[conn->in_size] = '\0';
+    char *end = strstr(conn->in, "\r\n\r\n");
+    if (end == NULL) {
+        if (conn->in_size == REQUEST_MAX) {
+            conn->keep_alive = false;
+            respond(conn, 431, NULL, NULL);
+        }
+        return;
+    }
+    *end = '\0';
+    // request line
+    char *method = conn->in;
+    char *target = strchr(method, ' ');
+    char *version = target != NULL ? strchr(target + 1, ' ') : NULL;
+    char *headers = strstr(conn->in, "\r\n");
+    if (headers == NULL) headers = end;
+    if (target == NULL || version == NULL || version > headers) {
+        conn->keep_alive = false;
+        respond(conn, 400, NULL, NULL);
+        return;
+    }
+    *target++ = '\0';
+    *version++ = '\0';
+    // HTTP/1.1 keeps the connection alive unless told not to, 1.0 the reverse
+    const char *connection = find_header(headers, "Connection");
+    conn->keep_alive = strncmp(version, "HTTP/1.1", 8) == 0
+        ? !header_has(connection, "close", true)
+        : header_has(connection, "keep-alive", true);
+    conn->head_only = strcmp(method, "HEAD") == 0;
+    const char *if_none_match = find_header(headers, "If-None-Match");
+    // parsed, drop it from the input (after reading what's needed from it)
+    Request request;
+    int status = strcmp(method, "GET") == 0 || conn->head_only
+        ? parse_target(target, &request) : 405;
+    char key[KEY_MAX];
+    char tag[KEY_MAX + 2];
+    bool cached = false;
+    if (status == 200) {
+        request_key(&request, key);
+        snprintf(tag, sizeof(tag), "\"%s\"", key);
+        // etags are case-sensitive
+        cached = header_has(if_none_match, tag, false)
+            || header_has(if_none_match, "*", false);
+    }
+    size_t used = end + 4 - conn->in;
+    memmove(conn->in, conn->in + used, conn->in_size - used);
+    conn->in_size -= used;
+
+    if (status != 200) {
+        // any body of the request is left unread
+        if (status == 405) conn->keep_alive = false;
+        respond(conn, status, NULL, NULL);
+    } else if (cached) {
+        not_modified++;
+        respond(conn, 304, NULL, key);
+    } else {
+        Response *response = cache_get(key);
+        if (response != NULL) {
+            hits++;
+            respond(conn, 200, response, key);
+            return;
+        }
+        // generate it on a worker, not reading meanwhile
+        misses++;
+        Job *job = malloc(sizeof(Job));
+        if (job == NULL) {
+            conn->keep_alive = false;
+            respond(conn, 500, NULL, NULL);
+            return;
+        }
+        *job = (Job) {.conn = conn, .request = request};
+        strcpy(job->key, key);
+        conn->working = true;
+        watch(conn, 0);
+        push_job(&todo, job);
+    }
+}
+
+static void close_connection(Connection *conn) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    release(conn->body);
+    conn->body = NULL;
+    if (conn->working) conn->closed = true; // freed when the job is done
+    else free(conn);
+}
+
+/* reads what the client sent, handling the request once it has it. */
+static void read_connection(Connection *conn) {
+    ssize_t n = read(conn->fd, conn->in + conn->in_size,
+        REQUEST_MAX - conn->in_size);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+        close_connection(conn);
+        return;
+    }
+    if (n > 0) conn->in_size += n;
+    handle_request(conn);
+}
+
+/* sends what's left of the response. once it's all sent, goes on to the
+ * next request (or closes the connection).
+ */
+static void write_connection(Connection *conn) {
+    while (conn->sending) {
+        struct iovec parts[2];
+        int count = 0;
+        size_t sent = conn->sent;
+        if (sent < conn->head_size) {
+            parts[count++] = (struct iovec) {.iov_base = conn->head + sent,
+                .iov_len = conn->head_size - sent};
+            sent = 0;
+        } else {
+            sent -= conn->head_size;
+        }
+        const char *body = conn->body != NULL ? (char *) conn->body->body
+            : conn->error;
+        size_t body_size = conn->body != NULL ? conn->body->size
+            : conn->error != NULL ? strlen(conn->error) : 0;
+        if (sent < body_size) {
+            parts[count++] = (struct iovec) {.iov_base = (char *) body + sent,
+                .iov_len = body_size - sent};
+        }
+        if (count == 0) {
+            // all sent
+            conn->sending = false;
+            release(conn->body);
+            conn->body = NULL;
+            conn->error = NULL;
+            if (!conn->keep_alive) {
+                close_connection(conn);
+                return;
+            }
+            watch(conn, EPOLLIN);
+            // the client may have sent the next request already
+            if (conn->in_size > 0) handle_request(conn);
+            return;
+        }
+        ssize_t n = writev(conn->fd, parts, count);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EINTR) return;
+            close_connection(conn);
+            return;
+        }
+        conn->sent += n;
+    }
+}
+
+/* sends the responses of the jobs workers have finished. */
+static void finish_jobs() {
+    uint64_t signals;
+    if (read(done_fd, &signals, sizeof(signals)) < 0 && errno != EAGAIN) {
+        perror("eventfd");
+    }
+    Job *jobs = take_jobs(&done);
+    while (jobs != NULL) {
+        Job *job = jobs;
+        jobs = job->next;
+        Connection *conn = job->conn;
+        conn->working = false;
+        if (conn->closed) {
+            release(job->response);
+            free(conn);
+        } else if (job->response == NULL) {
+            conn->keep_alive = false;
+            respond(conn, 500, NULL, NULL);
+        } else {
+            respond(conn, 200, job->response, job->key);
+        }
+        free(job);
+    }
+}
+
+/* accepts all waiting connections. */
+static void accept_connections(int listen_fd) {
+    while (true) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EINTR) perror("accept");
+            return;
+        }
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        Connection *conn = calloc(1, sizeof(Connection));
+        if (conn == NULL) {
+            close(fd);
+            continue;
+        }
+        conn->fd = fd;
+        struct epoll_event event = {.events = EPOLLIN, .data.ptr = conn};
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            close(fd);
+            free(conn);
+        }
+    }
+}
+
+/* opens the listening socket on localhost. returns -1 after printing an
+ * error.
+ */
+static int listen_on(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int one = 1;
+    struct sockaddr_in address = {.sin_family = AF_INET,
+        .sin_port = htons(port), .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    if (fd < 0 || setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one,
+        sizeof(one)) != 0
+    || bind(fd, (struct sockaddr *) &address, sizeof(address)) != 0
+    || listen(fd, SOMAXCONN) != 0) {
+        fprintf(stderr, "Failed to listen on port %d: %s\n", port,
+            strerror(errno));
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* prints requests/s since the last report, if there were any. */
+static void report(double elapsed) {
+    if (requests == 0) return;
+    pthread_mutex_lock(&cache.lock);
+    size_t bytes = cache.bytes;
+    pthread_mutex_unlock(&cache.lock);
+    fprintf(stderr, "%llu requests (%.0f/s), %llu not modified, cache %llu "
+        "hits / %llu misses, %.1f MB cached\n", (unsigned long long) requests,
+        requests / elapsed, (unsigned long long) not_modified,
+        (unsigned long long) hits, (unsigned long long) misses, bytes / 1e6);
+    total_requests += requests;
+    requests = not_modified = hits = misses = 0;
+}
+
+int serve_main(int argc, char **argv) {
+    int port = 8080;
+    int cache_mb = 64;
+    int interval = 5;
+    int threads = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "p:c:i:j:")) != -1) {
+        bool valid = true;
+        switch (opt) {
+            case 'p': valid = parse_positive(optarg, &port) && port < 65536;
+                break;
+            case 'c': valid = parse_positive(optarg, &cache_mb); break;
+            case 'i': valid = parse_positive(optarg, &interval); break;
+            case 'j': valid = parse_positive(optarg, &threads); break;
+            default: valid = false; break;
+        }
+        if (!valid) {
+            fputs(USAGE, stderr);
+            return EXIT_FAILURE;
+        }
+    }
+    if (optind < argc) {
+        fputs(USAGE, stderr);
+        return EXIT_FAILURE;
+    }
+    if (threads == 0) threads = parallel_threads();
+
+    int listen_fd = listen_on(port);
+    if (listen_fd < 0) return EXIT_FAILURE;
+    cache.capacity = (size_t) cache_mb << 20;
+    cache.bucket_count = 1 << 16;
+    cache.buckets = calloc(cache.bucket_count, sizeof(Response *));
+    pthread_t *workers = malloc(sizeof(pthread_t) * threads);
+    if (cache.buckets == NULL || workers == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return EXIT_FAILURE;
+    }
+    pthread_mutex_init(&cache.lock, NULL);
+    pthread_mutex_init(&todo.lock, NULL);
+    pthread_cond_init(&todo.ready, NULL);
+    pthread_mutex_init(&done.lock, NULL);
+    pthread_cond_init(&done.ready, NULL);
+    done_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    // the listener and the eventfd are told apart by their data
+    struct epoll_event listen_event = {.events = EPOLLIN, 
+        .data.ptr = &listen_fd};
+    struct epoll_event done_event = {.events = EPOLLIN, .data.ptr = &done_fd};
+    if (done_fd < 0 || epoll_fd < 0 
+    || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &listen_event) != 0
+    || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, done_fd, &done_event) != 0) {
+        fprintf(stderr, "Failed to start server: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    atomic_store(&running, true);
+    for (int i = 0; i < threads; i++) {
+        int error = pthread_create(&workers[i], NULL, work, NULL);
+        if (error != 0) {
+            // without its workers the server would take requests it never
+            // answers
+            fprintf(stderr, "Failed to start worker thread: %s\n", 
+                strerror(error));
+            exit(EXIT_FAILURE);
+        }
+    }
+    signal(SIGINT, on_interrupt);
+    signal(SIGTERM, on_interrupt);
+    signal(SIGPIPE, SIG_IGN);
+    fprintf(stderr, "Serving on http://127.0.0.1:%d/ with %d threads\n",
+        port, threads);
+
+    // event loop
+    struct epoll_event events[MAX_EVENTS];
+    double last_report = seconds();
+    while (!interrupted) {
+        int n = epoll_wait(epoll_fd, events, MAX_EVENTS, 1000);
+        for (int i = 0; i < n; i++) {
+            void *ptr = events[i].data.ptr;
+            if (ptr == &listen_fd) {
+                accept_connections(listen_fd);
+            } else if (ptr == &done_fd) {
+                finish_jobs();
+            } else {
+                Connection *conn = ptr;
+                if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                    close_connection(conn);
+                } else if (events[i].events & EPOLLOUT) {
+                    write_connection(conn);
+                } else if (events[i].events & EPOLLIN) {
+                    read_connection(conn);
+                }
+            }
+        }
+        double now = seconds();
+        if (now - last_report >= interval) {
+            report(now - last_report);
+            last_report = now;
+        }
+    }
+
+    // stop the workers. open connections are left to the OS
+    atomic_store(&running, false);
+    pthread_mutex_lock(&todo.lock);
+    pthread_cond_broadcast(&todo.ready);
+    pthread_mutex_unlock(&todo.lock);
+    for (int i = 0; i < threads; i++) pthread_join(workers[i], NULL);
+    free(workers);
+    close(listen_fd);
+    report(seconds() - last_report);
+    fprintf(stderr, "Stopped after %llu requests\n",
+        (unsigned long long) total_requests);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,503 @@
+/* verify.c - checks that every way of generating artifacts gives the same
+    ones as the reference generator
+    author: Andrew Klinge
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "commands.h"
+#include "generator.h"
+#include "parallel.h"
+
+// ids per block. blocks are the unit of work and are digested on their own,
+// so shards are made of whole blocks and a wrong one can be found quickly
+#define BLOCK_SIZE (1 << 16)
+// default ids per shard of a digest
+#define SHARD_SIZE (1 << 24)
+// artifacts generated at once by a worker
+#define VERIFY_BATCH 64
+// seconds between progress reports
+#define REPORT_INTERVAL 10
+// pixels of an artifact
+#define AREA (GENERATED_SIZE * GENERATED_SIZE)
+
+// FNV-1a's 64-bit offset basis and prime
+#define DIGEST_BASIS 0xcbf29ce484222325ull
+#define DIGEST_PRIME 0x100000001b3ull
+
+static const char *USAGE =
+    "usage: artifactor verify [options] [FIRST LAST]\n"
+    "Checks that every backend (way of generating artifacts) generates\n"
+    "artifacts FIRST to LAST (inclusive, default: all ids) exactly like the\n"
+    "reference generator (the original scalar code, symmetry and all), by\n"
+    "digesting them in shards on all cores. Prints each backend's throughput\n"
+    "and the first id it gets wrong, if any, and exits with 1 if any does.\n"
+    "  -b BACKENDS  comma separated backends to check (default: all):\n"
+    "               reference, format, packed, batched, pixels (v1 only)\n"
+    "               or rgba\n"
+    "  -g FILE      check against the digests saved in FILE instead of the\n"
+    "               reference, for the ids, shards and version saved in it\n"
+    "  -o FILE      save the reference's digests to FILE, for -g\n"
+    "  -s IDS       ids per shard, a multiple of 65536 (default: 16777216)\n"
+    "  -v VERSION   generator: v1 (default) or v2\n"
+    "  -j THREADS   worker threads (default: number of cores)\n";
+
+/* generates count artifacts from first_id on into pixels, one after
+ * another, the way generate_artifact() gives them.
+ */
+typedef void (*Generate)(int *pixels, uint32_t first_id, int count,
+    int version);
+
+/* generate_artifact_r(), or generate_artifact_v2(): the original code, a
+ * draw at a time and symmetrized by symmetrize() rather than the symmetry
+ * tables, so it shares none of the optimized paths it checks.
+ */
+static void run_reference(int *pixels, uint32_t first_id, int count,
+        int version) {
+    ArtifactRand rng;
+    for (int i = 0; i < count; i++) {
+        if (version == ARTIFACT_V1) {
+            generate_artifact_r(pixels + i * AREA, first_id + i, &rng);
+        } else {
+            generate_artifact_v2(pixels + i * AREA, first_id + i);
+        }
+    }
+}
+
+/* generate_artifact_format() of the default format. */
+static void run_format(int *pixels, uint32_t first_id, int count,
+        int version) {
+    ArtifactFormat format = ARTIFACT_DEFAULT_FORMAT;
+    format.version = version;
+    for (int i = 0; i < count; i++) {
+        generate_artifact_format(pixels + i * AREA, first_id + i, &format);
+    }
+}
+
+/* generate_artifact_packed(), one id at a time. */
+static void run_packed(int *pixels, uint32_t first_id, int count,
+        int version) {
+    for (int i = 0; i < count; i++) {
+        PackedArtifact packed;
+        generate_artifact_packed(&packed, first_id + i, version);
+        expand_artifact(&packed, pixels + i * AREA);
+    }
+}
+
+/* generate_artifacts_packed(), in vector lanes. */
+static void run_batched(int *pixels, uint32_t first_id, int count,
+        int version) {
+    PackedArtifact packed[VERIFY_BATCH];
+    generate_artifacts_packed(packed, first_id, count, version);
+    for (int i = 0; i < count; i++) {
+        expand_artifact(&packed[i], pixels + i * AREA);
+    }
+}
+
+/* generate_artifacts() (v1 only). */
+static void run_pixels(int *pixels, uint32_t first_id, int count,
+        int version) {
+    generate_artifacts(pixels, first_id, count);
+}
+
+/* generate_artifacts_rgba(), which without an alpha mask gives the same
+ * pixels as the others.
+ */
+static void run_rgba(int *pixels, uint32_t first_id, int count,
+        int version) {
+    ArtifactFormat format = ARTIFACT_DEFAULT_FORMAT;
+    format.version = version;
+    generate_artifacts_rgba((uint32_t *) pixels, first_id, count, &format, 0);
+}
+
+typedef struct Backend {
+    const char *name;
+    Generate generate;
+    bool v1_only;
+} Backend;
+
+static const Backend BACKENDS[] = {
+    {"reference", run_reference, false},
+    {"format", run_format, false},
+    {"packed", run_packed, false},
+    {"batched", run_batched, false},
+    {"pixels", run_pixels, true},
+    {"rgba", run_rgba, false},
+};
+#define BACKEND_COUNT (int) (sizeof(BACKENDS) / sizeof(BACKENDS[0]))
+
+/* a backend's digests of a range of ids. */
+typedef struct Run {
+    const Backend *backend;
+    int version;
+    uint32_t first; // first id of the range
+    uint64_t count; // ids in the range
+    uint64_t *blocks; // digest of each block
+
+    pthread_mutex_t lock; // guards everything below
+    uint64_t digested;
+    double start_time;
+    double last_report;
+} Run;
+
+/* adds a word to a digest. a word that differs always changes it. */
+static inline uint64_t digest_add(uint64_t digest, uint64_t word) {
+    return (digest ^ word) * DIGEST_PRIME;
+}
+
+/* digests the pixels of count artifacts into digest. */
+static uint64_t digest_pixels(uint64_t digest, const int *pixels,
+        int count) {
+    for (int i = 0; i < count * AREA; i += 2) {
+        digest = digest_add(digest, (uint32_t) pixels[i]
+            | (uint64_t) (uint32_t) pixels[i + 1] << 32);
+    }
+    return digest;
+}
+
+/* returns the digest of the blocks [first, first + count). */
+static uint64_t digest_blocks(const uint64_t *blocks, uint64_t first,
+        uint64_t count) {
+    uint64_t digest = DIGEST_BASIS;
+    for (uint64_t i = first; i < first + count; i++) {
+        digest = digest_add(digest, blocks[i]);
+    }
+    return digest;
+}
+
+/* digests blocks of ids [first + start, first + start + count). */
+static void digest_ids(void *ctx, uint64_t start, uint64_t count,
+        int worker) {
+    Run *run = ctx;
+    for (uint64_t block = start; block < start + count;
+    block += BLOCK_SIZE) {
+        uint64_t end = block + BLOCK_SIZE;
+        if (end > start + count) end = start + count;
+        uint64_t digest = DIGEST_BASIS;
+        int pixels[VERIFY_BATCH * AREA];
+        for (uint64_t i = block; i < end; i += VERIFY_BATCH) {
+            int n = end - i < VERIFY_BATCH ? end - i : VERIFY_BATCH;
+            run->backend->generate(pixels, run->first + i, n, run->version);
+            digest = digest_pixels(digest, pixels, n);
+        }
+        run->blocks[block / BLOCK_SIZE] = digest;
+    }
+
+    pthread_mutex_lock(&run->lock);
+    run->digested += count;
+    double now = seconds();
+    if (now - run->last_report >= REPORT_INTERVAL) {
+        run->last_report = now;
+        double elapsed = now - run->start_time;
+        fprintf(stderr, "%s: %llu/%llu ids (%.1f%%), %.0f ids/s\n",
+            run->backend->name, (unsigned long long) run->digested,
+            (unsigned long long) run->count,
+            100.0 * run->digested / run->count, run->digested / elapsed);
+    }
+    pthread_mutex_unlock(&run->lock);
+}
+
+/* digests every block of the run's ids on all threads. returns the ids
+ * digested per second.
+ */
+static double digest_run(Run *run, int threads) {
+    run->blocks = malloc(sizeof(uint64_t)
+        * ((run->count + BLOCK_SIZE - 1) / BLOCK_SIZE));
+    if (run->blocks == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    pthread_mutex_init(&run->lock, NULL);
+    run->digested = 0;
+    run->start_time = seconds();
+    run->last_report = run->start_time;
+    parallel_for(run->count, BLOCK_SIZE, threads, digest_ids, run);
+    pthread_mutex_destroy(&run->lock);
+    return run->count / (seconds() - run->start_time);
+}
+
+/* finds the first of ids [first, first + count) that the two backends
+ * generate differently. returns false if there is none.
+ */
+static bool find_difference(const Backend *backend, const Backend *expected,
+        int version, uint32_t first, uint64_t count, uint32_t *id) {
+    int pixels[VERIFY_BATCH * AREA];
+    int want[VERIFY_BATCH * AREA];
+    for (uint64_t i = 0; i < count; i += VERIFY_BATCH) {
+        int n = count - i < VERIFY_BATCH ? count - i : VERIFY_BATCH;
+        backend->generate(pixels, first + i, n, version);
+        expected->generate(want, first + i, n, version);
+        for (int k = 0; k < n; k++) {
+            if (memcmp(pixels + k * AREA, want + k * AREA,
+                sizeof(int) * AREA) != 0) {
+                *id = first + i + k;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/* saved digests of a range of ids, or the ones a run is checked against. */
+typedef struct Digests {
+    int version;
+    uint32_t first;
+    uint32_t last;
+    uint64_t shard_size; // ids per shard
+    uint64_t shards;
+    uint64_t *digests; // of each shard
+} Digests;
+
+/* sets the shards of the digests for their ids, and allocates them. */
+static void alloc_shards(Digests *digests) {
+    const uint64_t count = (uint64_t) digests->last - digests->first + 1;
+    digests->shards = (count + digests->shard_size - 1) / digests->shard_size;
+    digests->digests = malloc(sizeof(uint64_t) * digests->shards);
+    if (digests->digests == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* digests each shard of a run. */
+static void digest_shards(const Run *run, Digests *digests) {
+    const uint64_t blocks = (run->count + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    const uint64_t per_shard = digests->shard_size / BLOCK_SIZE;
+    for (uint64_t i = 0; i < digests->shards; i++) {
+        uint64_t first = i * per_shard;
+        uint64_t count = blocks - first < per_shard ? blocks - first
+            : per_shard;
+        digests->digests[i] = digest_blocks(run->blocks, first, count);
+    }
+}
+
+/* saves digests to a file: a line of their version, ids and shard size,
+ * then one line per shard. returns false after printing an error if it
+ * can't.
+ */
+static bool save_digests(const Digests *digests, const char *path) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    fprintf(file, "%s %u %u %llu\n", artifact_version_name(digests->version),
+        digests->first, digests->last,
+        (unsigned long long) digests->shard_size);
+    for (uint64_t i = 0; i < digests->shards; i++) {
+        fprintf(file, "%016llx\n", (unsigned long long) digests->digests[i]);
+    }
+    if (fclose(file) != 0) {
+        fprintf(stderr, "Failed to save %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+/* loads digests saved by save_digests(). returns false after printing an
+ * error if it can't.
+ */
+static bool load_digests(Digests *digests, const char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    char version[8];
+    unsigned long long shard_size;
+    bool valid = fscanf(file, "%7s %u %u %llu", version, &digests->first,
+        &digests->last, &shard_size) == 4;
+    digests->version = artifact_version_by_name(version);
+    digests->shard_size = shard_size;
+    valid = valid && digests->version >= 0 && digests->first <= digests->last
+        && shard_size > 0 && shard_size % BLOCK_SIZE == 0;
+    if (valid) {
+        alloc_shards(digests);
+        for (uint64_t i = 0; i < digests->shards && valid; i++) {
+            unsigned long long digest;
+            valid = fscanf(file, "%llx", &digest) == 1;
+            digests->digests[i] = digest;
+        }
+    }
+    fclose(file);
+    if (!valid) fprintf(stderr, "%s is not a digest file\n", path);
+    return valid;
+}
+
+/* parses a comma separated list of backends into selected. returns false if
+ * one is not a backend.
+ */
+static bool parse_backends(const char *list, bool *selected) {
+    char names[256];
+    snprintf(names, sizeof(names), "%s", list);
+    for (int i = 0; i < BACKEND_COUNT; i++) selected[i] = false;
+    for (char *name = strtok(names, ","); name != NULL;
+    name = strtok(NULL, ",")) {
+        int i = 0;
+        while (i < BACKEND_COUNT && strcmp(name, BACKENDS[i].name) != 0) i++;
+        if (i == BACKEND_COUNT) return false;
+        selected[i] = true;
+    }
+    return true;
+}
+
+int verify_main(int argc, char **argv) {
+    bool selected[BACKEND_COUNT];
+    for (int i = 0; i < BACKEND_COUNT; i++) selected[i] = true;
+    bool all = true; // whether the backends are all by default
+    const char *golden = NULL;
+    const char *output = NULL;
+    int shard_size = SHARD_SIZE;
+    int threads = 0;
+    Digests expected = {.version = ARTIFACT_V1, .first = 0,
+        .last = UINT32_MAX};
+
+    int opt;
+    while ((opt = getopt(argc, argv, "b:g:o:s:v:j:")) != -1) {
+        bool valid = true;
+        switch (opt) {
+            case 'b':
+                valid = parse_backends(optarg, selected);
+                all = false;
+                break;
+            case 'g': golden = optarg; break;
+            case 'o': output = optarg; break;
+            case 's':
+                valid = parse_positive(optarg, &shard_size)
+                    && shard_size % BLOCK_SIZE == 0;
+                break;
+            case 'v':
+                expected.version = artifact_version_by_name(optarg);
+                valid = expected.version >= 0;
+                break;
+            case 'j': valid = parse_positive(optarg, &threads); break;
+            default: valid = false; break;
+        }
+        if (!valid) {
+            fputs(USAGE, stderr);
+            return EXIT_FAILURE;
+        }
+    }
+    if ((optind != argc && optind + 2 != argc)
+    || (optind + 2 == argc && (!parse_id(argv[optind], &expected.first)
+        || !parse_id(argv[optind + 1], &expected.last)
+        || expected.last < expected.first))
+    || (golden != NULL && (output != NULL || optind != argc))) {
+        fputs(USAGE, stderr);
+        return EXIT_FAILURE;
+    }
+    expected.shard_size = shard_size;
+
+    if (golden != NULL) {
+        if (!load_digests(&expected, golden)) return EXIT_FAILURE;
+    } else {
+        alloc_shards(&expected);
+    }
+    const int version = expected.version;
+    for (int i = 0; i < BACKEND_COUNT; i++) {
+        if (selected[i] && BACKENDS[i].v1_only && version != ARTIFACT_V1) {
+            if (!all) {
+                fprintf(stderr, "Backend %s only generates v1\n",
+                    BACKENDS[i].name);
+                return EXIT_FAILURE;
+            }
+            selected[i] = false;
+        }
+    }
+
+    // everything is checked against the reference, unless saved digests
+    // are given
+    const Backend *reference = &BACKENDS[0];
+    Run expected_run = {.backend = reference, .version = version,
+        .first = expected.first,
+        .count = (uint64_t) expected.last - expected.first + 1};
+    printf("%s ids %u to %u, %llu shard(s) of %llu\n",
+        artifact_version_name(version), expected.first, expected.last,
+        (unsigned long long) expected.shards,
+        (unsigned long long) expected.shard_size);
+    if (golden == NULL) {
+        double rate = digest_run(&expected_run, threads);
+        digest_shards(&expected_run, &expected);
+        printf("%-10s %12.0f ids/s  (expected)\n", reference->name, rate);
+        selected[0] = false;
+        if (output != NULL && !save_digests(&expected, output)) {
+            return EXIT_FAILURE;
+        }
+    }
+    printf("%-10s %016llx\n", "digest", (unsigned long long)
+        digest_blocks(expected.digests, 0, expected.shards));
+
+    bool failed = false;
+    Digests got = expected;
+    alloc_shards(&got);
+    for (int i = 0; i < BACKEND_COUNT; i++) {
+        if (!selected[i]) continue;
+        Run run = expected_run;
+        run.backend = &BACKENDS[i];
+        double rate = digest_run(&run, threads);
+        digest_shards(&run, &got);
+        uint64_t shard = 0;
+        while (shard < expected.shards
+        && got.digests[shard] == expected.digests[shard]) shard++;
+        printf("%-10s %12.0f ids/s  ", run.backend->name, rate);
+        if (shard == expected.shards) {
+            printf("ok\n");
+            free(run.blocks);
+            continue;
+        }
+        failed = true;
+
+        // find the first block that differs from the reference's,
+        // digesting the reference's blocks of the shard if only its digest
+        // was saved
+        const uint64_t per_shard = expected.shard_size / BLOCK_SIZE;
+        uint64_t first = shard * per_shard;
+        uint64_t blocks = (run.count + BLOCK_SIZE - 1) / BLOCK_SIZE - first;
+        if (blocks > per_shard) blocks = per_shard;
+        Run reference_run = expected_run;
+        if (golden != NULL) {
+            reference_run.first = expected.first + first * BLOCK_SIZE;
+            reference_run.count = run.count - first * BLOCK_SIZE;
+            if (reference_run.count > expected.shard_size) {
+                reference_run.count = expected.shard_size;
+            }
+            digest_run(&reference_run, threads);
+            if (digest_blocks(reference_run.blocks, 0, blocks)
+            != expected.digests[shard]) {
+                printf("shard %llu doesn't match %s, but neither does the "
+                    "reference\n", (unsigned long long) shard, golden);
+                free(reference_run.blocks);
+                free(run.blocks);
+                continue;
+            }
+            first = 0;
+        }
+        uint64_t block = 0;
+        while (block < blocks - 1
+        && run.blocks[shard * per_shard + block]
+            == reference_run.blocks[first + block]) block++;
+        uint32_t start = reference_run.first + (first + block) * BLOCK_SIZE;
+        uint64_t count = expected.first + run.count - (uint64_t) start;
+        if (count > BLOCK_SIZE) count = BLOCK_SIZE;
+        uint32_t id;
+        if (find_difference(run.backend, reference, version, start, count,
+            &id)) {
+            printf("FAILED: first wrong id %u\n", id);
+        } else {
+            // generates differently from one run to the next
+            printf("FAILED: ids %u to %u digest differently, but generate "
+                "the same again\n", start, (uint32_t) (start + count - 1));
+        }
+        if (golden != NULL) free(reference_run.blocks);
+        free(run.blocks);
+    }
+    free(got.digests);
+    free(expected.digests);
+    if (golden == NULL) free(expected_run.blocks);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}